@@ -0,0 +1,74 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : Atomic.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef ATOMIC_H_
+#define ATOMIC_H_
+
+namespace TTP
+{
+
+// Thin wrappers around the GCC __atomic builtins, so the lock-free parts
+// of the pool can be written against C++98. The order argument takes the
+// __ATOMIC_* constants and defaults to sequential consistency.
+
+template <typename T>
+inline T atomicLoad(const volatile T *ptr, int order = __ATOMIC_SEQ_CST)
+{
+    return __atomic_load_n(ptr, order);
+}
+
+template <typename T>
+inline void atomicStore(volatile T *ptr, T value, int order = __ATOMIC_SEQ_CST)
+{
+    __atomic_store_n(ptr, value, order);
+}
+
+// returns the value after the addition
+template <typename T>
+inline T atomicAdd(volatile T *ptr, T value, int order = __ATOMIC_SEQ_CST)
+{
+    return __atomic_add_fetch(ptr, value, order);
+}
+
+// returns the value after the subtraction
+template <typename T>
+inline T atomicSub(volatile T *ptr, T value, int order = __ATOMIC_SEQ_CST)
+{
+    return __atomic_sub_fetch(ptr, value, order);
+}
+
+template <typename T>
+inline T atomicExchange(volatile T *ptr, T value, int order = __ATOMIC_SEQ_CST)
+{
+    return __atomic_exchange_n(ptr, value, order);
+}
+
+// on failure expected is updated with the current value
+template <typename T>
+inline bool atomicCas(volatile T *ptr, T &expected, T desired,
+        int order = __ATOMIC_SEQ_CST)
+{
+    return __atomic_compare_exchange_n(ptr, &expected, desired, false,
+            order, __ATOMIC_RELAXED);
+}
+
+inline void atomicFence(int order = __ATOMIC_SEQ_CST)
+{
+    __atomic_thread_fence(order);
+}
+
+// hint to the cpu that we are busy waiting
+inline void cpuRelax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+} // namespace TTP
+
+#endif /* ATOMIC_H_ */
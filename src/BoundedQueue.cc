@@ -0,0 +1,142 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : BoundedQueue.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#include "Atomic.h"
+#include "BoundedQueue.h"
+
+namespace TTP
+{
+
+BoundedQueue::BoundedQueue(long capacity)
+{
+    unsigned long size = 2;
+    while (static_cast<long>(size) < capacity) {
+        size <<= 1;
+    }
+    m_cells = new Cell[size];
+    m_mask = size - 1;
+    for (unsigned long i = 0; i < size; ++i) {
+        m_cells[i].m_sequence = i;
+        m_cells[i].m_task = NULL;
+    }
+    m_enqueuePos = 0;
+    m_dequeuePos = 0;
+}
+
+BoundedQueue::~BoundedQueue()
+{
+    delete[] m_cells;
+}
+
+bool BoundedQueue::push(Task *task)
+{
+    Cell *cell = NULL;
+    unsigned long pos = atomicLoad(&m_enqueuePos, __ATOMIC_RELAXED);
+    while (true) {
+        cell = &m_cells[pos & m_mask];
+        unsigned long seq = atomicLoad(&cell->m_sequence, __ATOMIC_ACQUIRE);
+        long diff = static_cast<long>(seq) - static_cast<long>(pos);
+        if (diff == 0) {
+            // the cell is free for this lap, claim the position
+            if (atomicCas(&m_enqueuePos, pos, pos + 1, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // the consumer of the previous lap has not freed the cell
+            return false;
+        }
+        else {
+            pos = atomicLoad(&m_enqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+    cell->m_task = task;
+    atomicStore(&cell->m_sequence, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+long BoundedQueue::push(Task **tasks, long count)
+{
+    long claimed = 0;
+    unsigned long pos = atomicLoad(&m_enqueuePos, __ATOMIC_RELAXED);
+    while (count > 0) {
+        // cells free for this lap, only a producer owning their position
+        // may change them and our CAS keeps everybody else in front
+        claimed = 0;
+        while (claimed < count) {
+            unsigned long index = pos + claimed;
+            unsigned long seq = atomicLoad(&m_cells[index & m_mask].m_sequence, __ATOMIC_ACQUIRE);
+            if (seq != index) {
+                break;
+            }
+            ++claimed;
+        }
+        if (claimed == 0) {
+            unsigned long seq = atomicLoad(&m_cells[pos & m_mask].m_sequence, __ATOMIC_ACQUIRE);
+            if (static_cast<long>(seq) - static_cast<long>(pos) < 0) {
+                return 0;
+            }
+            pos = atomicLoad(&m_enqueuePos, __ATOMIC_RELAXED);
+        }
+        else if (atomicCas(&m_enqueuePos, pos, pos + claimed, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    for (long i = 0; i < claimed; ++i) {
+        Cell *cell = &m_cells[(pos + i) & m_mask];
+        cell->m_task = tasks[i];
+        atomicStore(&cell->m_sequence, pos + i + 1, __ATOMIC_RELEASE);
+    }
+    return claimed;
+}
+
+Task* BoundedQueue::pop()
+{
+    Cell *cell = NULL;
+    unsigned long pos = atomicLoad(&m_dequeuePos, __ATOMIC_RELAXED);
+    while (true) {
+        cell = &m_cells[pos & m_mask];
+        unsigned long seq = atomicLoad(&cell->m_sequence, __ATOMIC_ACQUIRE);
+        long diff = static_cast<long>(seq) - static_cast<long>(pos + 1);
+        if (diff == 0) {
+            if (atomicCas(&m_dequeuePos, pos, pos + 1, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // nothing published at this position yet
+            return NULL;
+        }
+        else {
+            pos = atomicLoad(&m_dequeuePos, __ATOMIC_RELAXED);
+        }
+    }
+    Task *task = cell->m_task;
+    // hand the cell to the producer of the next lap
+    atomicStore(&cell->m_sequence, pos + m_mask + 1, __ATOMIC_RELEASE);
+    return task;
+}
+
+long BoundedQueue::size() const
+{
+    unsigned long head = atomicLoad(&m_dequeuePos, __ATOMIC_ACQUIRE);
+    unsigned long tail = atomicLoad(&m_enqueuePos, __ATOMIC_ACQUIRE);
+    long size = static_cast<long>(tail - head);
+    return size > 0 ? size : 0;
+}
+
+bool BoundedQueue::empty() const
+{
+    return size() == 0;
+}
+
+long BoundedQueue::capacity() const
+{
+    return static_cast<long>(m_mask + 1);
+}
+
+} // namespace TTP
@@ -0,0 +1,58 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : BoundedQueue.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef BOUNDEDQUEUE_H_
+#define BOUNDEDQUEUE_H_
+#include "Task.h"
+
+namespace TTP
+{
+
+// Bounded multi-producer multi-consumer queue of tasks after Dmitry
+// Vyukov's design: a power of two ring of cells, each carrying a
+// sequence number that tells producers and consumers whose turn it is.
+// push() and pop() never lock and never allocate.
+class BoundedQueue
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit BoundedQueue(long capacity);
+    ~BoundedQueue();
+    // returns false if the queue is full
+    bool push(Task *task);
+    // claims room for up to count tasks with a single CAS, returns
+    // the number of tasks pushed, 0 if the queue is full
+    long push(Task **tasks, long count);
+    // returns NULL if the queue is empty
+    Task* pop();
+    // approximate, exact only while no other thread works on the queue
+    long size() const;
+    bool empty() const;
+    long capacity() const;
+private:
+    struct Cell
+    {
+        volatile unsigned long m_sequence;
+        Task *m_task;
+    };
+    enum { CACHELINE = 64 };
+private:
+    BoundedQueue(const BoundedQueue&);
+    BoundedQueue& operator = (const BoundedQueue&);
+private:
+    char m_pad0[CACHELINE];
+    Cell *m_cells;
+    unsigned long m_mask;
+    char m_pad1[CACHELINE];
+    volatile unsigned long m_enqueuePos;
+    char m_pad2[CACHELINE];
+    volatile unsigned long m_dequeuePos;
+    char m_pad3[CACHELINE];
+};
+
+} // namespace TTP
+#endif /* BOUNDEDQUEUE_H_ */
@@ -0,0 +1,44 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : Continuation.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef CONTINUATION_H_
+#define CONTINUATION_H_
+
+namespace TTP
+{
+
+class Task;
+
+// Join point of a continuation, shared by all its predecessors. The
+// predecessor that drops m_pending to 0 queues m_task, the last one
+// to let go of it deletes it.
+class Join
+{
+public:
+    Join(Task *task, long pending, long refs)
+    :m_task(task)
+    ,m_pending(pending)
+    ,m_refs(refs)
+    {}
+    Task *m_task;
+    // 1 for whenAny(), the number of predecessors for whenAll()
+    volatile long m_pending;
+    volatile long m_refs;
+};
+
+// Entry in the list of continuations of one predecessor, owned by the
+// pool so that a task may delete itself in run()
+class Successor
+{
+public:
+    explicit Successor(Join *join):m_join(join), m_next(NULL) {}
+    Join *m_join;
+    Successor *m_next;
+};
+
+} // namespace TTP
+#endif /* CONTINUATION_H_ */
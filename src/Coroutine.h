@@ -0,0 +1,211 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : Coroutine.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef COROUTINE_H_
+#define COROUTINE_H_
+
+// The library itself builds as C++98, the coroutine layer is only
+// available to code compiled as C++20 or later.
+#if __cplusplus >= 202002L
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include "ThreadPool.h"
+#include "Mutex.h"
+
+namespace TTP
+{
+
+// Returned by schedule(), suspends the awaiting coroutine and queues
+// it on the pool, a PoolThread resumes it. The awaiter is the Task
+// itself and lives in the coroutine frame, nothing is allocated.
+class ScheduleAwaiter : public Task
+{
+public:
+    ScheduleAwaiter(ThreadPool &pool, long long delay, int unit)
+    :m_pool(pool)
+    ,m_delay(delay)
+    ,m_unit(unit)
+    {}
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        m_handle = handle;
+        if (m_unit < 0 || !m_pool.defers(m_delay, m_unit)) {
+            // a refused task resumes the coroutine on the calling thread
+            return m_pool.execute(this);
+        }
+        // the timer takes every deferred task, its handle is never
+        // empty; the coroutine may already run once schedule() returns
+        return !m_pool.schedule(this, m_delay, m_unit).isEmpty();
+    }
+    void await_resume() const noexcept {}
+    void run() {
+        // the frame, and this awaiter with it, may be gone once
+        // resume() returns
+        m_handle.resume();
+    }
+private:
+    ThreadPool &m_pool;
+    long long m_delay;
+    int m_unit;
+    std::coroutine_handle<> m_handle;
+};
+
+// co_await schedule(pool) continues the coroutine on a PoolThread
+inline ScheduleAwaiter schedule(ThreadPool &pool)
+{
+    return ScheduleAwaiter(pool, -1, -1);
+}
+
+// co_await schedule(pool, 10, TimeUnit::MILLISECONDS) continues the
+// coroutine on a PoolThread once the pool's timer expired, no thread
+// is blocked meanwhile
+inline ScheduleAwaiter schedule(ThreadPool &pool, long long tunit, int type)
+{
+    return ScheduleAwaiter(pool, tunit, type);
+}
+
+// Completion state of a CoTask coroutine: the coroutine awaiting it,
+// or a thread blocked in CoTask::get()
+class CoPromiseBase
+{
+public:
+    class FinalAwaiter
+    {
+    public:
+        bool await_ready() const noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            return handle.promise().finish();
+        }
+        void await_resume() const noexcept {}
+    };
+    CoPromiseBase():m_done(false) {}
+    // lazy, the coroutine starts when it is awaited
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { m_error = std::current_exception(); }
+    // resumes the awaiting coroutine on this thread, or wakes get()
+    std::coroutine_handle<> finish() noexcept {
+        if (m_continuation) {
+            return m_continuation;
+        }
+        m_cond.lock();
+        m_done = true;
+        m_cond.broadcast();
+        m_cond.unlock();
+        return std::noop_coroutine();
+    }
+    void wait() {
+        m_cond.lock();
+        while (!m_done) {
+            m_cond.wait();
+        }
+        m_cond.unlock();
+    }
+    void check() {
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+    }
+    std::coroutine_handle<> m_continuation;
+private:
+    Condition m_cond;
+    bool m_done;
+    std::exception_ptr m_error;
+};
+
+template <typename T>
+class CoTask;
+
+template <typename T>
+class CoPromise : public CoPromiseBase
+{
+public:
+    CoTask<T> get_return_object();
+    template <typename U>
+    void return_value(U &&value) { m_value.emplace(std::forward<U>(value)); }
+    T result() {
+        check();
+        return std::move(*m_value);
+    }
+private:
+    std::optional<T> m_value;
+};
+
+template <>
+class CoPromise<void> : public CoPromiseBase
+{
+public:
+    CoTask<void> get_return_object();
+    void return_void() const noexcept {}
+    void result() { check(); }
+};
+
+// Coroutine returning T. co_await on a CoTask starts it and suspends
+// the awaiting coroutine until it returned, without blocking a
+// PoolThread; the awaiting coroutine continues on the thread that
+// finished the CoTask. An exception leaving the coroutine is rethrown
+// to the awaiter. Named CoTask because Task is the pool's work item.
+template <typename T = void>
+class CoTask
+{
+public:
+    typedef CoPromise<T> promise_type;
+    explicit CoTask(std::coroutine_handle<promise_type> handle):m_handle(handle) {}
+    CoTask(CoTask &&other) noexcept:m_handle(std::exchange(other.m_handle, nullptr)) {}
+    CoTask& operator = (CoTask &&other) noexcept {
+        if (this != &other) {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    // must not be destroyed while the coroutine runs
+    ~CoTask() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        m_handle.promise().m_continuation = awaiting;
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().result(); }
+    // starts the coroutine on the calling thread and blocks until it
+    // returned, for code outside of any coroutine
+    T get() {
+        m_handle.resume();
+        m_handle.promise().wait();
+        return m_handle.promise().result();
+    }
+private:
+    CoTask(const CoTask&);
+    CoTask& operator = (const CoTask&);
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template <typename T>
+CoTask<T> CoPromise<T>::get_return_object()
+{
+    return CoTask<T>(std::coroutine_handle<CoPromise<T> >::from_promise(*this));
+}
+
+inline CoTask<void> CoPromise<void>::get_return_object()
+{
+    return CoTask<void>(std::coroutine_handle<CoPromise<void> >::from_promise(*this));
+}
+
+} // namespace TTP
+
+#endif /* __cplusplus >= 202002L */
+#endif /* COROUTINE_H_ */
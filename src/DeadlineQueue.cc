@@ -0,0 +1,122 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : DeadlineQueue.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#include <stddef.h>
+#include <limits.h>
+#include "DeadlineQueue.h"
+
+namespace TTP
+{
+
+DeadlineQueue::DeadlineQueue()
+{
+    m_sequence = 0;
+}
+
+bool DeadlineQueue::before(const Entry &a, const Entry &b)
+{
+    if (a.m_deadline != b.m_deadline) {
+        return a.m_deadline < b.m_deadline;
+    }
+    return a.m_sequence < b.m_sequence;
+}
+
+void DeadlineQueue::place(long index, const Entry &entry)
+{
+    m_heap[index] = entry;
+    entry.m_task->m_heapIndex = index;
+}
+
+void DeadlineQueue::push(Task *task)
+{
+    Entry entry;
+    entry.m_deadline = task->m_deadline >= 0 ? task->m_deadline : LLONG_MAX;
+    entry.m_sequence = m_sequence++;
+    entry.m_task = task;
+    m_heap.push_back(entry);
+    task->m_heapIndex = static_cast<long>(m_heap.size()) - 1;
+    siftUp(task->m_heapIndex);
+}
+
+Task* DeadlineQueue::pop()
+{
+    if (m_heap.empty()) {
+        return NULL;
+    }
+    Task *task = m_heap[0].m_task;
+    remove(task);
+    return task;
+}
+
+bool DeadlineQueue::remove(Task *task)
+{
+    long index = task->m_heapIndex;
+    if (index < 0 || index >= static_cast<long>(m_heap.size())
+            || m_heap[index].m_task != task) {
+        return false;
+    }
+    task->m_heapIndex = -1;
+    long last = static_cast<long>(m_heap.size()) - 1;
+    if (index != last) {
+        // the last entry fills the hole and moves whichever way it must
+        place(index, m_heap[last]);
+        m_heap.pop_back();
+        siftDown(index);
+        siftUp(index);
+    }
+    else {
+        m_heap.pop_back();
+    }
+    return true;
+}
+
+bool DeadlineQueue::empty() const
+{
+    return m_heap.empty();
+}
+
+long DeadlineQueue::size() const
+{
+    return static_cast<long>(m_heap.size());
+}
+
+void DeadlineQueue::siftUp(long index)
+{
+    Entry entry = m_heap[index];
+    while (index > 0) {
+        long parent = (index - 1) / 2;
+        if (!before(entry, m_heap[parent])) {
+            break;
+        }
+        place(index, m_heap[parent]);
+        index = parent;
+    }
+    place(index, entry);
+}
+
+void DeadlineQueue::siftDown(long index)
+{
+    long count = static_cast<long>(m_heap.size());
+    Entry entry = m_heap[index];
+    for (;;) {
+        long child = 2 * index + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && before(m_heap[child + 1], m_heap[child])) {
+            ++child;
+        }
+        if (!before(m_heap[child], entry)) {
+            break;
+        }
+        place(index, m_heap[child]);
+        index = child;
+    }
+    place(index, entry);
+}
+
+} // namespace TTP
@@ -0,0 +1,52 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : DeadlineQueue.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef DEADLINEQUEUE_H_
+#define DEADLINEQUEUE_H_
+#include <vector>
+#include "Task.h"
+
+namespace TTP
+{
+
+// Ready queue of an earliest deadline first pool: a binary min-heap on
+// Task::m_deadline, tasks without a deadline go last, ties in FIFO
+// order. Every task knows its heap index, so a queued task can be
+// withdrawn in O(log n). Not thread safe, the TaskPool guards it with
+// its mutex. A task must not be queued twice at the same time.
+class DeadlineQueue
+{
+public:
+    DeadlineQueue();
+    void push(Task *task);
+    // the task with the nearest deadline, NULL if empty
+    Task* pop();
+    // false if task is not queued here
+    bool remove(Task *task);
+    bool empty() const;
+    long size() const;
+private:
+    struct Entry
+    {
+        long long m_deadline;
+        unsigned long long m_sequence;
+        Task *m_task;
+    };
+private:
+    DeadlineQueue(const DeadlineQueue&);
+    DeadlineQueue& operator = (const DeadlineQueue&);
+    static bool before(const Entry &a, const Entry &b);
+    void place(long index, const Entry &entry);
+    void siftUp(long index);
+    void siftDown(long index);
+private:
+    std::vector<Entry> m_heap;
+    unsigned long long m_sequence;
+};
+
+} // namespace TTP
+#endif /* DEADLINEQUEUE_H_ */
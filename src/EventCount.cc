@@ -0,0 +1,132 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : EventCount.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+#include "Atomic.h"
+#include "Timer.h"
+#include "EventCount.h"
+
+namespace TTP
+{
+
+EventCount::EventCount()
+{
+    m_epoch = 0;
+    m_waiters = 0;
+}
+
+unsigned int EventCount::prepareWait()
+{
+    // counted before the epoch is read, a notifier that published
+    // after this either sees the waiter or the waiter sees its work
+    atomicAdd(&m_waiters, 1);
+    return atomicLoad(&m_epoch);
+}
+
+void EventCount::cancelWait()
+{
+    atomicSub(&m_waiters, 1);
+}
+
+int EventCount::waiters() const
+{
+    return atomicLoad(&m_waiters, __ATOMIC_RELAXED);
+}
+
+void EventCount::wait(unsigned int key)
+{
+#if defined(__linux__)
+    while (atomicLoad(&m_epoch, __ATOMIC_ACQUIRE) == key) {
+        syscall(SYS_futex, &m_epoch, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+    }
+#else
+    m_cond.lock();
+    while (atomicLoad(&m_epoch, __ATOMIC_ACQUIRE) == key) {
+        m_cond.wait();
+    }
+    m_cond.unlock();
+#endif
+    atomicSub(&m_waiters, 1);
+}
+
+bool EventCount::wait(unsigned int key, long milliseconds)
+{
+    long long deadline = Timer::getCurrentTime() + milliseconds * 1000000LL;
+    bool moved = true;
+#if defined(__linux__)
+    while (atomicLoad(&m_epoch, __ATOMIC_ACQUIRE) == key) {
+        long long left = deadline - Timer::getCurrentTime();
+        if (left <= 0) {
+            moved = false;
+            break;
+        }
+        struct timespec timeout;
+        timeout.tv_sec = static_cast<time_t>(left / 1000000000LL);
+        timeout.tv_nsec = static_cast<long>(left % 1000000000LL);
+        syscall(SYS_futex, &m_epoch, FUTEX_WAIT_PRIVATE, key, &timeout, NULL, 0);
+    }
+#else
+    m_cond.lock();
+    while (atomicLoad(&m_epoch, __ATOMIC_ACQUIRE) == key) {
+        if (!m_cond.waitUntil(deadline) && atomicLoad(&m_epoch) == key) {
+            moved = false;
+            break;
+        }
+    }
+    m_cond.unlock();
+#endif
+    atomicSub(&m_waiters, 1);
+    return moved;
+}
+
+void EventCount::notify(long count)
+{
+    atomicFence();
+    if (atomicLoad(&m_waiters, __ATOMIC_RELAXED) > 0) {
+        wake(count);
+    }
+}
+
+void EventCount::notifyAll()
+{
+    atomicFence();
+    if (atomicLoad(&m_waiters, __ATOMIC_RELAXED) > 0) {
+        wake(INT_MAX);
+    }
+}
+
+void EventCount::wake(long count)
+{
+    int waking = count > INT_MAX ? INT_MAX : static_cast<int>(count);
+#if defined(__linux__)
+    atomicAdd(&m_epoch, 1U);
+    // the woken threads count themselves out in wait(), so m_waiters
+    // has a single writer per waiter and never drops below zero
+    syscall(SYS_futex, &m_epoch, FUTEX_WAKE_PRIVATE, waking, NULL, NULL, 0);
+#else
+    m_cond.lock();
+    atomicAdd(&m_epoch, 1U);
+    if (waking == INT_MAX) {
+        m_cond.broadcast();
+    }
+    else {
+        for (int i = 0; i < waking; ++i) {
+            m_cond.signal();
+        }
+    }
+    m_cond.unlock();
+#endif
+}
+
+} // namespace TTP
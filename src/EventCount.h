@@ -0,0 +1,50 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : EventCount.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef EVENTCOUNT_H_
+#define EVENTCOUNT_H_
+#include "Mutex.h"
+
+namespace TTP
+{
+
+// Parks threads waiting for a predicate that other threads make true
+// without a lock. A waiter takes a key with prepareWait(), checks its
+// predicate and either calls cancelWait() or wait(key); a notifier
+// makes the predicate true first and then calls notify(). A notify()
+// after prepareWait() is never lost, and one that finds nobody waiting
+// costs a fence and a load. On Linux the waiters sleep on a futex on
+// the epoch, elsewhere on a Condition.
+class EventCount
+{
+public:
+    EventCount();
+    unsigned int prepareWait();
+    void cancelWait();
+    // returns once the epoch moved past key
+    void wait(unsigned int key);
+    // false if the epoch did not move within milliseconds
+    bool wait(unsigned int key, long milliseconds);
+    // wakes up to count waiters
+    void notify(long count = 1);
+    void notifyAll();
+    // threads between prepareWait() and the end of their wait
+    int waiters() const;
+private:
+    EventCount(const EventCount&);
+    EventCount& operator = (const EventCount&);
+    void wake(long count);
+private:
+    volatile unsigned int m_epoch;
+    volatile int m_waiters;
+#if !defined(__linux__)
+    Condition m_cond;
+#endif
+};
+
+} // namespace TTP
+#endif /* EVENTCOUNT_H_ */
@@ -0,0 +1,201 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : FunctionTask.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#include "Atomic.h"
+#include "FunctionTask.h"
+
+namespace TTP
+{
+
+FunctionTask::FunctionTask()
+{
+    m_storage.m_pointer = NULL;
+    m_discard = NULL;
+    m_slots = NULL;
+    m_spare = false;
+}
+
+void FunctionTask::run()
+{
+    m_invoke(this);
+}
+
+void FunctionTask::discard()
+{
+    m_discard(this);
+    recycle();
+}
+
+void FunctionTask::expired()
+{
+    discard();
+}
+
+void* FunctionTask::allocateBlock(size_t size, size_t alignment)
+{
+    if (m_slots == NULL || alignment > __alignof__(Storage)) {
+        return NULL;
+    }
+    return m_slots->allocate(size);
+}
+
+void FunctionTask::freeBlock(void *block, size_t size)
+{
+    m_slots->deallocate(block, size);
+}
+
+void FunctionTask::recycle()
+{
+    if (m_spare || m_slots == NULL) {
+        delete this;
+    }
+    else {
+        m_slots->release(this);
+    }
+}
+
+FunctionSlots::FunctionSlots(size_t count)
+{
+    m_count = count;
+    m_state = EMPTY;
+    m_slots = NULL;
+    m_freeSlots.m_head = 0;
+    m_freeSlots.m_next = NULL;
+    for (int i = 0; i < CLASSES; ++i) {
+        m_blocks[i] = NULL;
+        m_freeBlocks[i].m_head = 0;
+        m_freeBlocks[i].m_next = NULL;
+    }
+}
+
+FunctionSlots::~FunctionSlots()
+{
+    delete [] m_slots;
+    delete [] m_freeSlots.m_next;
+    for (int i = 0; i < CLASSES; ++i) {
+        delete [] m_blocks[i];
+        delete [] m_freeBlocks[i].m_next;
+    }
+}
+
+void FunctionSlots::prepare()
+{
+    int state = EMPTY;
+    if (!atomicCas(&m_state, state, static_cast<int>(PREPARING))) {
+        while (atomicLoad(&m_state, __ATOMIC_ACQUIRE) != READY) {
+            cpuRelax();
+        }
+        return;
+    }
+    m_slots = m_count > 0 ? new FunctionTask[m_count] : NULL;
+    for (size_t i = 0; i < m_count; ++i) {
+        m_slots[i].m_slots = this;
+    }
+    initialize(m_freeSlots, m_count);
+    for (int i = 0; i < CLASSES; ++i) {
+        size_t blocks = m_count / 8;
+        // a multiple of the largest alignment new char[] guarantees
+        m_blocks[i] = blocks > 0 ? new char[blocks * (BLOCK >> (CLASSES - 1 - i))] : NULL;
+        initialize(m_freeBlocks[i], blocks);
+    }
+    atomicStore(&m_state, static_cast<int>(READY), __ATOMIC_RELEASE);
+}
+
+FunctionTask* FunctionSlots::acquire()
+{
+    if (atomicLoad(&m_state, __ATOMIC_ACQUIRE) != READY) {
+        prepare();
+    }
+    unsigned int entry = pop(m_freeSlots);
+    if (entry == 0) {
+        FunctionTask *task = new FunctionTask;
+        // still draws its functor's block from here
+        task->m_slots = this;
+        task->m_spare = true;
+        return task;
+    }
+    return &m_slots[entry - 1];
+}
+
+void FunctionSlots::release(FunctionTask *task)
+{
+    push(m_freeSlots, static_cast<unsigned int>(task - m_slots) + 1);
+}
+
+void* FunctionSlots::allocate(size_t size)
+{
+    int index = blockClass(size);
+    if (index < 0) {
+        return NULL;
+    }
+    if (atomicLoad(&m_state, __ATOMIC_ACQUIRE) != READY) {
+        prepare();
+    }
+    unsigned int entry = pop(m_freeBlocks[index]);
+    if (entry == 0) {
+        return NULL;
+    }
+    return m_blocks[index] + (entry - 1) * (BLOCK >> (CLASSES - 1 - index));
+}
+
+void FunctionSlots::deallocate(void *block, size_t size)
+{
+    int index = blockClass(size);
+    size_t offset = static_cast<size_t>(static_cast<char*>(block) - m_blocks[index]);
+    push(m_freeBlocks[index], static_cast<unsigned int>(offset / (BLOCK >> (CLASSES - 1 - index))) + 1);
+}
+
+int FunctionSlots::blockClass(size_t size)
+{
+    for (int i = 0; i < CLASSES; ++i) {
+        if (size <= BLOCK >> (CLASSES - 1 - i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void FunctionSlots::initialize(FreeList &list, size_t count)
+{
+    list.m_next = count > 0 ? new unsigned int[count] : NULL;
+    for (size_t i = 0; i < count; ++i) {
+        list.m_next[i] = i + 1 < count ? static_cast<unsigned int>(i + 2) : 0;
+    }
+    list.m_head = count > 0 ? 1 : 0;
+}
+
+unsigned int FunctionSlots::pop(FreeList &list)
+{
+    unsigned long long head = atomicLoad(&list.m_head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        unsigned int entry = static_cast<unsigned int>(head & 0xffffffffULL);
+        if (entry == 0) {
+            return 0;
+        }
+        // may read an entry that was just taken, the tag makes the CAS fail
+        unsigned int next = atomicLoad(&list.m_next[entry - 1], __ATOMIC_RELAXED);
+        unsigned long long desired = ((head >> 32) + 1) << 32 | next;
+        if (atomicCas(&list.m_head, head, desired)) {
+            return entry;
+        }
+    }
+}
+
+void FunctionSlots::push(FreeList &list, unsigned int entry)
+{
+    unsigned long long head = atomicLoad(&list.m_head, __ATOMIC_RELAXED);
+    for (;;) {
+        atomicStore(&list.m_next[entry - 1], static_cast<unsigned int>(head & 0xffffffffULL),
+                __ATOMIC_RELAXED);
+        unsigned long long desired = ((head >> 32) + 1) << 32 | entry;
+        if (atomicCas(&list.m_head, head, desired)) {
+            return;
+        }
+    }
+}
+
+} // namespace TTP
@@ -0,0 +1,220 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : FunctionTask.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef FUNCTIONTASK_H_
+#define FUNCTIONTASK_H_
+#include <new>
+#include <cstddef>
+#include "Task.h"
+
+namespace TTP
+{
+
+class FunctionSlots;
+
+// IsTask<F>::value is true for Task subclasses and pointers to them,
+// keeps ThreadPool::execute(const F&) away from the Task overloads
+template <typename F>
+class IsTask
+{
+    static char test(const volatile Task*);
+    static long test(...);
+    static F* pointer();
+    static F& reference();
+public:
+    static const bool value = sizeof(test(pointer())) == sizeof(char)
+                           || sizeof(test(reference())) == sizeof(char);
+};
+
+template <bool Condition, typename T = void>
+class EnableIf
+{
+};
+
+template <typename T>
+class EnableIf<true, T>
+{
+public:
+    typedef T type;
+};
+
+// A functor queued with ThreadPool::execute(const F&). Functors up to
+// STORAGE bytes are copied into the task itself, larger ones up to
+// FunctionSlots::BLOCK bytes into a block of its FunctionSlots; only
+// bigger functors, or more in flight than the slabs hold, are copied
+// to the heap. The PoolThread calls the functor through m_invoke, the
+// task goes back to its FunctionSlots right after.
+class FunctionTask : public Task
+{
+    friend class FunctionSlots;
+public:
+    static const size_t STORAGE = 48;
+public:
+    FunctionTask();
+    // for callers that run tasks themselves, e.g. a TaskGroup waiter
+    void run();
+    template <typename F>
+    void assign(const F &fn) {
+        if (sizeof(F) <= STORAGE && __alignof__(F) <= __alignof__(Storage)) {
+            new (m_storage.m_bytes) F(fn);
+            m_invoke = &FunctionTask::callInline<F>;
+            m_discard = &FunctionTask::discardInline<F>;
+        }
+        else if (void *block = allocateBlock(sizeof(F), __alignof__(F))) {
+            try {
+                m_storage.m_pointer = new (block) F(fn);
+            }
+            catch(...) {
+                freeBlock(block, sizeof(F));
+                throw;
+            }
+            m_invoke = &FunctionTask::callBlock<F>;
+            m_discard = &FunctionTask::discardBlock<F>;
+        }
+        else {
+            m_storage.m_pointer = new F(fn);
+            m_invoke = &FunctionTask::callHeap<F>;
+            m_discard = &FunctionTask::discardHeap<F>;
+        }
+    }
+    // drops the functor without calling it, e.g. the queue was full
+    void discard();
+    void expired();
+private:
+    template <typename F>
+    static void callInline(Task *task) {
+        FunctionTask *self = static_cast<FunctionTask*>(task);
+        F *fn = static_cast<F*>(static_cast<void*>(self->m_storage.m_bytes));
+        try {
+            (*fn)();
+        }
+        catch(...) {
+            fn->~F();
+            self->recycle();
+            throw;
+        }
+        fn->~F();
+        self->recycle();
+    }
+    template <typename F>
+    static void callBlock(Task *task) {
+        FunctionTask *self = static_cast<FunctionTask*>(task);
+        F *fn = static_cast<F*>(self->m_storage.m_pointer);
+        try {
+            (*fn)();
+        }
+        catch(...) {
+            discardBlock<F>(self);
+            self->recycle();
+            throw;
+        }
+        discardBlock<F>(self);
+        self->recycle();
+    }
+    template <typename F>
+    static void callHeap(Task *task) {
+        FunctionTask *self = static_cast<FunctionTask*>(task);
+        F *fn = static_cast<F*>(self->m_storage.m_pointer);
+        try {
+            (*fn)();
+        }
+        catch(...) {
+            delete fn;
+            self->recycle();
+            throw;
+        }
+        delete fn;
+        self->recycle();
+    }
+    template <typename F>
+    static void discardInline(FunctionTask *self) {
+        static_cast<F*>(static_cast<void*>(self->m_storage.m_bytes))->~F();
+    }
+    template <typename F>
+    static void discardBlock(FunctionTask *self) {
+        static_cast<F*>(self->m_storage.m_pointer)->~F();
+        self->freeBlock(self->m_storage.m_pointer, sizeof(F));
+    }
+    template <typename F>
+    static void discardHeap(FunctionTask *self) {
+        delete static_cast<F*>(self->m_storage.m_pointer);
+    }
+    // a block of its FunctionSlots for a functor, NULL if there is none
+    void* allocateBlock(size_t size, size_t alignment);
+    void freeBlock(void *block, size_t size);
+    // hands the task back to its slots, or deletes it
+    void recycle();
+private:
+    FunctionTask(const FunctionTask&);
+    FunctionTask& operator = (const FunctionTask&);
+private:
+    union Storage {
+        char m_bytes[STORAGE];
+        void *m_pointer;
+        long m_long;
+        double m_double;
+        long double m_longDouble;
+    };
+    Storage m_storage;
+    void (*m_discard)(FunctionTask*);
+    FunctionSlots *m_slots;
+    // allocated because the slots ran out, deleted after the call
+    bool m_spare;
+};
+
+// Fixed slab of FunctionTasks owned by a ThreadPool, and slabs of
+// count / 8 blocks each of BLOCK / 4, BLOCK / 2 and BLOCK bytes for
+// the functors too large to fit into a task and for the proxies of
+// TaskGroups, which may outlive their group but never the pool. Every
+// free list is lock-free, its head packs a tag above the index, so an
+// entry popped and pushed again in between cannot fool a CAS. The
+// slabs are allocated by the first acquire() or allocate(), a pool
+// that never queues a functor or a group does without them.
+class FunctionSlots
+{
+public:
+    static const size_t BLOCK = 512;
+public:
+    explicit FunctionSlots(size_t count);
+    ~FunctionSlots();
+    // a free slot, or a heap allocated task if all slots are in use
+    FunctionTask* acquire();
+    void release(FunctionTask *task);
+    // a free block of at least size bytes, NULL if size is above BLOCK
+    // or the blocks of its size are all in use
+    void* allocate(size_t size);
+    void deallocate(void *block, size_t size);
+private:
+    enum { CLASSES = 3 };
+    // a free list over entries 1 to count, 0 ends it
+    struct FreeList
+    {
+        volatile unsigned long long m_head;
+        volatile unsigned int *m_next;
+    };
+    FunctionSlots(const FunctionSlots&);
+    FunctionSlots& operator = (const FunctionSlots&);
+    // allocates the slabs once, callers racing the first one wait
+    void prepare();
+    static void initialize(FreeList &list, size_t count);
+    // the entry taken off list, 0 if it is empty
+    static unsigned int pop(FreeList &list);
+    static void push(FreeList &list, unsigned int entry);
+    // the smallest block class for size
+    static int blockClass(size_t size);
+private:
+    enum { EMPTY, PREPARING, READY };
+    size_t m_count;
+    volatile int m_state;
+    FunctionTask *m_slots;
+    FreeList m_freeSlots;
+    char *m_blocks[CLASSES];
+    FreeList m_freeBlocks[CLASSES];
+};
+
+} // namespace TTP
+#endif /* FUNCTIONTASK_H_ */
@@ -0,0 +1,97 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : Future.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#include "Atomic.h"
+#include "Future.h"
+#include "Timer.h"
+
+namespace TTP
+{
+
+FutureStateBase::FutureStateBase()
+{
+    // the creator holds the first reference
+    m_refs = 1;
+    m_ready = false;
+    m_failed = false;
+}
+
+FutureStateBase::~FutureStateBase()
+{
+}
+
+void FutureStateBase::retain()
+{
+    atomicAdd(&m_refs, 1);
+}
+
+void FutureStateBase::release()
+{
+    if (atomicSub(&m_refs, 1) == 0) {
+        delete this;
+    }
+}
+
+void FutureStateBase::complete()
+{
+    m_cond.lock();
+    atomicStore(&m_ready, true, __ATOMIC_RELEASE);
+    m_cond.broadcast();
+    m_cond.unlock();
+}
+
+void FutureStateBase::fail(const std::string &error)
+{
+    m_cond.lock();
+    m_error = error;
+    m_failed = true;
+    atomicStore(&m_ready, true, __ATOMIC_RELEASE);
+    m_cond.broadcast();
+    m_cond.unlock();
+}
+
+bool FutureStateBase::isReady()
+{
+    return atomicLoad(&m_ready, __ATOMIC_ACQUIRE);
+}
+
+void FutureStateBase::wait()
+{
+    if (isReady()) {
+        return;
+    }
+    m_cond.lock();
+    while (!m_ready) {
+        m_cond.wait();
+    }
+    m_cond.unlock();
+}
+
+bool FutureStateBase::wait(long milliseconds)
+{
+    if (isReady()) {
+        return true;
+    }
+    // a wake-up for nothing must not restart the timeout
+    long long deadline = Timer::getCurrentTime() + milliseconds * 1000000LL;
+    m_cond.lock();
+    while (!m_ready && m_cond.waitUntil(deadline)) {
+    }
+    bool ready = m_ready;
+    m_cond.unlock();
+    return ready;
+}
+
+void FutureStateBase::check()
+{
+    wait();
+    if (m_failed) {
+        throw TaskException(m_error);
+    }
+}
+
+} // namespace TTP
@@ -0,0 +1,281 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : Future.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef FUTURE_H_
+#define FUTURE_H_
+#include <string>
+#include <stdexcept>
+#include "Task.h"
+#include "Mutex.h"
+
+namespace TTP
+{
+
+// thrown by Future::get() when the task ended with an exception,
+// what() carries the message of the original exception
+class TaskException : public std::runtime_error
+{
+public:
+    explicit TaskException(const std::string &what)
+    :std::runtime_error(what) {}
+};
+
+// Completion state shared between a Callable and its Futures,
+// reference counted because either side may go first.
+class FutureStateBase
+{
+public:
+    FutureStateBase();
+    virtual ~FutureStateBase();
+    void retain();
+    void release();
+    // wakes all waiters, called once the result is stored
+    void complete();
+    void fail(const std::string &error);
+    bool isReady();
+    void wait();
+    // returns false if the result was not ready within milliseconds
+    bool wait(long milliseconds);
+    // waits and throws TaskException if the task failed
+    void check();
+private:
+    FutureStateBase(const FutureStateBase&);
+    FutureStateBase& operator = (const FutureStateBase&);
+private:
+    Condition m_cond;
+    volatile int m_refs;
+    volatile bool m_ready;
+    bool m_failed;
+    std::string m_error;
+};
+
+template <typename T>
+class FutureState : public FutureStateBase
+{
+public:
+    FutureState():m_value() {}
+    T m_value;
+};
+
+template <>
+class FutureState<void> : public FutureStateBase
+{
+};
+
+// Handle on the result of a task submitted with ThreadPool::submit().
+// Copies share the same result. wait() and get() on a Future without
+// a result, e.g. a default constructed one, throw std::logic_error.
+template <typename T>
+class Future
+{
+public:
+    Future():m_state(NULL) {}
+    explicit Future(FutureState<T> *state):m_state(state) {
+        if (m_state != NULL) {
+            m_state->retain();
+        }
+    }
+    Future(const Future &other):m_state(other.m_state) {
+        if (m_state != NULL) {
+            m_state->retain();
+        }
+    }
+    ~Future() {
+        if (m_state != NULL) {
+            m_state->release();
+        }
+    }
+    Future& operator = (const Future &other) {
+        if (other.m_state != NULL) {
+            other.m_state->retain();
+        }
+        if (m_state != NULL) {
+            m_state->release();
+        }
+        m_state = other.m_state;
+        return *this;
+    }
+    // false for a default constructed Future
+    bool valid() const { return m_state != NULL; }
+    bool isReady() const { return m_state != NULL && m_state->isReady(); }
+    void wait() const { state().wait(); }
+    bool wait(long milliseconds) const { return state().wait(milliseconds); }
+    // blocks until the task finished, rethrows its failure as TaskException
+    T get() const {
+        state().check();
+        return m_state->m_value;
+    }
+private:
+    FutureState<T>& state() const {
+        if (m_state == NULL) {
+            throw std::logic_error("no state");
+        }
+        return *m_state;
+    }
+private:
+    FutureState<T> *m_state;
+};
+
+template <>
+class Future<void>
+{
+public:
+    Future():m_state(NULL) {}
+    explicit Future(FutureState<void> *state):m_state(state) {
+        if (m_state != NULL) {
+            m_state->retain();
+        }
+    }
+    Future(const Future &other):m_state(other.m_state) {
+        if (m_state != NULL) {
+            m_state->retain();
+        }
+    }
+    ~Future() {
+        if (m_state != NULL) {
+            m_state->release();
+        }
+    }
+    Future& operator = (const Future &other) {
+        if (other.m_state != NULL) {
+            other.m_state->retain();
+        }
+        if (m_state != NULL) {
+            m_state->release();
+        }
+        m_state = other.m_state;
+        return *this;
+    }
+    bool valid() const { return m_state != NULL; }
+    bool isReady() const { return m_state != NULL && m_state->isReady(); }
+    void wait() const { state().wait(); }
+    bool wait(long milliseconds) const { return state().wait(milliseconds); }
+    void get() const { state().check(); }
+private:
+    FutureState<void>& state() const {
+        if (m_state == NULL) {
+            throw std::logic_error("no state");
+        }
+        return *m_state;
+    }
+private:
+    FutureState<void> *m_state;
+};
+
+// A Task producing a value. Implement call(), submit it with
+// ThreadPool::submit() and collect the value from the returned Future.
+template <typename T>
+class Callable : public Task
+{
+    friend class ThreadPool;
+public:
+    Callable():m_state(NULL) {}
+    virtual ~Callable() {
+        if (m_state != NULL) {
+            m_state->release();
+        }
+    }
+    virtual T call() = 0;
+    void run() {
+        // the state outlives us, the owner may delete this task
+        // as soon as a waiter wakes up
+        FutureState<T> *state = m_state;
+        if (state == NULL) {
+            // run without submit(), nobody waits for the value
+            call();
+            return;
+        }
+        state->retain();
+        try {
+            state->m_value = call();
+            state->complete();
+        }
+        catch(std::exception &e) {
+            state->fail(e.what());
+        }
+        catch(...) {
+            state->fail("unknown exception");
+        }
+        state->release();
+    }
+    // the Future reports the dropped task as failed
+    void expired() {
+        FutureState<T> *state = m_state;
+        if (state == NULL) {
+            return;
+        }
+        state->retain();
+        state->fail("deadline expired");
+        state->release();
+    }
+private:
+    // a fresh state for every submission
+    Future<T> prepare() {
+        if (m_state != NULL) {
+            m_state->release();
+        }
+        m_state = new FutureState<T>;
+        return Future<T>(m_state);
+    }
+private:
+    FutureState<T> *m_state;
+};
+
+template <>
+class Callable<void> : public Task
+{
+    friend class ThreadPool;
+public:
+    Callable():m_state(NULL) {}
+    virtual ~Callable() {
+        if (m_state != NULL) {
+            m_state->release();
+        }
+    }
+    virtual void call() = 0;
+    void run() {
+        FutureState<void> *state = m_state;
+        if (state == NULL) {
+            call();
+            return;
+        }
+        state->retain();
+        try {
+            call();
+            state->complete();
+        }
+        catch(std::exception &e) {
+            state->fail(e.what());
+        }
+        catch(...) {
+            state->fail("unknown exception");
+        }
+        state->release();
+    }
+    void expired() {
+        FutureState<void> *state = m_state;
+        if (state == NULL) {
+            return;
+        }
+        state->retain();
+        state->fail("deadline expired");
+        state->release();
+    }
+private:
+    Future<void> prepare() {
+        if (m_state != NULL) {
+            m_state->release();
+        }
+        m_state = new FutureState<void>;
+        return Future<void>(m_state);
+    }
+private:
+    FutureState<void> *m_state;
+};
+
+} // namespace TTP
+#endif /* FUTURE_H_ */
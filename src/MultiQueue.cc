@@ -0,0 +1,148 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : MultiQueue.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#include <stddef.h>
+#include <limits.h>
+#include <algorithm>
+#include "Atomic.h"
+#include "MultiQueue.h"
+
+namespace TTP
+{
+
+namespace
+{
+    // xorshift state of the calling thread, 0 until first used
+    __thread unsigned int pickSeed;
+} // namespace anonymous
+
+const long long MultiQueue::EMPTY = LLONG_MIN;
+
+MultiQueue::MultiQueue(long heaps)
+{
+    m_count = heaps < 2 ? 2 : heaps;
+    m_heaps = new Heap[m_count];
+    for (long i = 0; i < m_count; ++i) {
+        m_heaps[i].m_lock = 0;
+        m_heaps[i].m_top = EMPTY;
+        m_heaps[i].m_sequence = 0;
+    }
+}
+
+MultiQueue::~MultiQueue()
+{
+    delete[] m_heaps;
+}
+
+long MultiQueue::pick() const
+{
+    unsigned int x = pickSeed;
+    if (x == 0) {
+        x = static_cast<unsigned int>(reinterpret_cast<size_t>(&pickSeed) >> 4) | 1;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    pickSeed = x;
+    return static_cast<long>(x % static_cast<unsigned long>(m_count));
+}
+
+bool MultiQueue::tryLock(Heap &heap) const
+{
+    int expected = 0;
+    return atomicLoad(&heap.m_lock, __ATOMIC_RELAXED) == 0
+            && atomicCas(&heap.m_lock, expected, 1);
+}
+
+void MultiQueue::unlock(Heap &heap) const
+{
+    atomicStore(&heap.m_lock, 0, __ATOMIC_RELEASE);
+}
+
+void MultiQueue::push(Task *task)
+{
+    Heap *heap = &m_heaps[pick()];
+    while (!tryLock(*heap)) {
+        // a busy heap is as good as any other
+        heap = &m_heaps[pick()];
+    }
+    Entry entry;
+    entry.m_priority = task->m_priority;
+    entry.m_sequence = heap->m_sequence++;
+    entry.m_task = task;
+    heap->m_entries.push_back(entry);
+    std::push_heap(heap->m_entries.begin(), heap->m_entries.end(), After());
+    atomicStore(&heap->m_top, static_cast<long long>(heap->m_entries.front().m_priority),
+            __ATOMIC_RELEASE);
+    unlock(*heap);
+}
+
+Task* MultiQueue::take(Heap &heap)
+{
+    if (heap.m_entries.empty()) {
+        return NULL;
+    }
+    std::pop_heap(heap.m_entries.begin(), heap.m_entries.end(), After());
+    Task *task = heap.m_entries.back().m_task;
+    heap.m_entries.pop_back();
+    long long top = EMPTY;
+    if (!heap.m_entries.empty()) {
+        top = heap.m_entries.front().m_priority;
+    }
+    atomicStore(&heap.m_top, top, __ATOMIC_RELEASE);
+    return task;
+}
+
+Task* MultiQueue::pop()
+{
+    // two random choices while they keep finding work ...
+    for (long attempt = 0; attempt < m_count; ++attempt) {
+        Heap &first = m_heaps[pick()];
+        Heap &second = m_heaps[pick()];
+        long long firstTop = atomicLoad(&first.m_top, __ATOMIC_ACQUIRE);
+        long long secondTop = atomicLoad(&second.m_top, __ATOMIC_ACQUIRE);
+        Heap &heap = secondTop > firstTop ? second : first;
+        if ((secondTop > firstTop ? secondTop : firstTop) == EMPTY) {
+            continue;
+        }
+        if (tryLock(heap)) {
+            Task *task = take(heap);
+            unlock(heap);
+            if (task != NULL) {
+                return task;
+            }
+        }
+    }
+    // ... then a sweep, so a lone task is not missed
+    for (long i = 0; i < m_count; ++i) {
+        Heap &heap = m_heaps[i];
+        while (atomicLoad(&heap.m_top, __ATOMIC_ACQUIRE) != EMPTY) {
+            if (tryLock(heap)) {
+                Task *task = take(heap);
+                unlock(heap);
+                if (task != NULL) {
+                    return task;
+                }
+                break;
+            }
+            cpuRelax();
+        }
+    }
+    return NULL;
+}
+
+bool MultiQueue::empty() const
+{
+    for (long i = 0; i < m_count; ++i) {
+        if (atomicLoad(&m_heaps[i].m_top, __ATOMIC_ACQUIRE) != EMPTY) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace TTP
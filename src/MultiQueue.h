@@ -0,0 +1,79 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : MultiQueue.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef MULTIQUEUE_H_
+#define MULTIQUEUE_H_
+#include <vector>
+#include "Task.h"
+
+namespace TTP
+{
+
+// Relaxed priority queue after Rihani, Sanders and Dementiev: a number
+// of binary heaps, each behind its own spin lock. push() goes to a
+// random heap, pop() compares the tops of two random heaps and takes
+// the higher one. The order is approximate, a task of rank r among the
+// queued ones is expected within about r * heaps / 2 pops, in exchange
+// producers and consumers hardly ever meet on a lock. Thread safe.
+class MultiQueue
+{
+public:
+    // heaps is raised to at least 2
+    explicit MultiQueue(long heaps);
+    ~MultiQueue();
+    // higher m_priority first, FIFO among equal ones of a heap
+    void push(Task *task);
+    // NULL once every heap was found empty
+    Task* pop();
+    // approximate, reads the cached tops only
+    bool empty() const;
+private:
+    struct Entry
+    {
+        int m_priority;
+        unsigned long m_sequence;
+        Task *m_task;
+    };
+    // true if a should come after b
+    class After
+    {
+    public:
+        bool operator () (const Entry &a, const Entry &b) const {
+            if (a.m_priority != b.m_priority) {
+                return a.m_priority < b.m_priority;
+            }
+            return a.m_sequence > b.m_sequence;
+        }
+    };
+    enum { CACHELINE = 64 };
+    struct Heap
+    {
+        volatile int m_lock;
+        // priority of the top entry, EMPTY when there is none; read
+        // without the lock to pick a heap
+        volatile long long m_top;
+        unsigned long m_sequence;
+        std::vector<Entry> m_entries;
+        char m_pad[CACHELINE];
+    };
+    static const long long EMPTY;
+private:
+    MultiQueue(const MultiQueue&);
+    MultiQueue& operator = (const MultiQueue&);
+    // a random heap index, from a per thread generator
+    long pick() const;
+    bool tryLock(Heap &heap) const;
+    void unlock(Heap &heap) const;
+    // pops the top of a locked heap, NULL if it ran empty meanwhile
+    Task* take(Heap &heap);
+private:
+    Heap *m_heaps;
+    long m_count;
+};
+
+} // namespace TTP
+#endif /* MULTIQUEUE_H_ */
@@ -251,7 +251,17 @@ ScopedLock::~ScopedLock()
 //
 Condition::Condition()
 {
+#if defined(__linux__)
+    // timed waits follow CLOCK_MONOTONIC like Timer, setting the
+    // wall clock does not stretch or cut them short
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_cond, &attr);
+    pthread_condattr_destroy(&attr);
+#else
     pthread_cond_init(&_cond,NULL);
+#endif
 }
 
 Condition::~Condition()
@@ -264,6 +274,46 @@ void Condition::wait()
     pthread_cond_wait(&_cond,&_mutex);
 }
 
+bool Condition::wait(long milliseconds)
+{
+    struct timespec abstime;
+#if defined(__linux__)
+    clock_gettime(CLOCK_MONOTONIC, &abstime);
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    abstime.tv_sec  = tv.tv_sec;
+    abstime.tv_nsec = tv.tv_usec*1000;
+#endif
+    abstime.tv_sec += milliseconds / 1000;
+    abstime.tv_nsec += (milliseconds % 1000) * 1000000;
+    if (abstime.tv_nsec >= 1000000000) {
+        abstime.tv_nsec -= 1000000000;
+        ++abstime.tv_sec;
+    }
+    return pthread_cond_timedwait(&_cond, &_mutex, &abstime) != ETIMEDOUT;
+}
+
+bool Condition::waitUntil(long long nanoseconds)
+{
+    struct timespec abstime;
+#if defined(__linux__)
+    abstime.tv_sec = static_cast<time_t>(nanoseconds / 1000000000LL);
+    abstime.tv_nsec = static_cast<long>(nanoseconds % 1000000000LL);
+#else
+    // the condition runs on the wall clock, translate the deadline
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long left = nanoseconds - (now.tv_sec * 1000000000LL + now.tv_nsec);
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    long long wall = tv.tv_sec * 1000000000LL + tv.tv_usec * 1000LL + (left > 0 ? left : 0);
+    abstime.tv_sec = static_cast<time_t>(wall / 1000000000LL);
+    abstime.tv_nsec = static_cast<long>(wall % 1000000000LL);
+#endif
+    return pthread_cond_timedwait(&_cond, &_mutex, &abstime) != ETIMEDOUT;
+}
+
 void Condition::signal()
 {
     pthread_cond_signal(&_cond);
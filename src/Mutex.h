@@ -166,6 +166,16 @@ public:
     // wait for signal to arrive
     void wait();
 
+    // wait for signal to arrive, returns false if
+    // no signal arrived within the given number of
+    // milliseconds
+    bool wait(long milliseconds);
+
+    // wait for signal to arrive, returns false if none
+    // arrived before the Timer::getCurrentTime() value
+    // given in nanoseconds
+    bool waitUntil(long long nanoseconds);
+
     // restart one of the threads, waiting on the cond. variable
     void signal();
 
@@ -0,0 +1,300 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : ParallelFor.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef PARALLELFOR_H_
+#define PARALLELFOR_H_
+#include <exception>
+#include <string>
+#include "Atomic.h"
+#include "ThreadPool.h"
+#include "TaskGroup.h"
+
+namespace TTP
+{
+
+// How parallelFor() and parallelReduce() split [begin, end)
+class Partition
+{
+public:
+    // one contiguous block per participating thread
+    static const int STATIC = 0;
+    // grain sized chunks handed out by a shared atomic counter
+    static const int DYNAMIC = 1;
+    // chunks shrink with the remaining work, never below grain
+    static const int GUIDED = 2;
+    // upper bound of the threads taking part in one loop, the
+    // calling thread included
+    static const int MAX_WORKERS = 64;
+};
+
+// The iteration space of one loop, shared by all participants and
+// living on the stack of the calling thread.
+template <typename Index>
+class LoopRange
+{
+public:
+    // grain <= 0 picks a grain from the loop length and the
+    // number of participants
+    LoopRange(Index begin, Index end, Index grain, int partition, int workers)
+    :m_begin(begin)
+    ,m_end(end)
+    ,m_grain(grain)
+    ,m_partition(partition)
+    ,m_workers(workers)
+    ,m_next(begin)
+    {
+        if (m_grain <= 0) {
+            m_grain = autoGrain(end - begin, partition, workers);
+        }
+    }
+    // number of threads worth waking for a loop of this length
+    static int participants(Index count, Index grain, int partition, int workers) {
+        if (grain <= 0) {
+            grain = autoGrain(count, partition, workers);
+        }
+        Index chunks = (count + grain - 1) / grain;
+        return chunks < static_cast<Index>(workers) ? static_cast<int>(chunks) : workers;
+    }
+    // hands out the next chunk to participant worker; round counts
+    // the chunks this participant already took, starting at 0
+    bool next(int worker, int round, Index &first, Index &last) {
+        if (m_partition == Partition::STATIC) {
+            if (round > 0) {
+                return false;
+            }
+            Index count = m_end - m_begin;
+            Index workers = static_cast<Index>(m_workers);
+            Index index = static_cast<Index>(worker);
+            Index block = count / workers;
+            Index extra = count % workers;
+            // the first extra blocks are one element longer
+            first = m_begin + block * index + (index < extra ? index : extra);
+            last = first + block + (index < extra ? 1 : 0);
+            return first < last;
+        }
+        Index current = atomicLoad(&m_next, __ATOMIC_RELAXED);
+        for (;;) {
+            if (current >= m_end) {
+                return false;
+            }
+            Index remaining = m_end - current;
+            Index chunk = m_grain;
+            if (m_partition == Partition::GUIDED) {
+                chunk = remaining / static_cast<Index>(2 * m_workers);
+                if (chunk < m_grain) {
+                    chunk = m_grain;
+                }
+            }
+            if (chunk > remaining) {
+                chunk = remaining;
+            }
+            if (atomicCas(&m_next, current, static_cast<Index>(current + chunk))) {
+                first = current;
+                last = current + chunk;
+                return true;
+            }
+        }
+    }
+private:
+    // about eight chunks per participant for DYNAMIC, GUIDED only
+    // uses it as the floor of its shrinking chunks
+    static Index autoGrain(Index count, int partition, int workers) {
+        Index grain = count / static_cast<Index>(8 * workers);
+        if (partition == Partition::GUIDED) {
+            grain = count / static_cast<Index>(32 * workers);
+        }
+        return grain > 0 ? grain : 1;
+    }
+private:
+    Index m_begin;
+    Index m_end;
+    Index m_grain;
+    int m_partition;
+    int m_workers;
+    volatile Index m_next;
+};
+
+// A participant of a loop. What its first failing call threw is kept
+// for the calling thread, which rethrows it once the loop is done.
+class LoopTask : public Task
+{
+public:
+    LoopTask():m_failed(false) {}
+    void run() {
+        try {
+            runChunks();
+        }
+        catch(std::exception &e) {
+            fail(e.what());
+        }
+        catch(...) {
+            fail("unknown exception");
+        }
+    }
+    bool failed() const { return m_failed; }
+    const std::string& error() const { return m_error; }
+protected:
+    virtual void runChunks() = 0;
+private:
+    void fail(const char *error) {
+        m_failed = true;
+        m_error = error;
+    }
+private:
+    bool m_failed;
+    std::string m_error;
+};
+
+// throws a TaskException with the error of the first failed task
+template <typename Participant>
+void rethrowFailure(const Participant *tasks, int count)
+{
+    for (int w = 0; w < count; ++w) {
+        if (tasks[w].failed()) {
+            throw TaskException(tasks[w].error());
+        }
+    }
+}
+
+// A participant of parallelFor(), calls body(i) for every index of
+// the chunks it takes
+template <typename Index, typename Body>
+class ForTask : public LoopTask
+{
+public:
+    ForTask():m_range(NULL), m_body(NULL), m_worker(0) {}
+    void init(LoopRange<Index> *range, const Body *body, int worker) {
+        m_range = range;
+        m_body = body;
+        m_worker = worker;
+    }
+protected:
+    void runChunks() {
+        Index first, last;
+        for (int round = 0; m_range->next(m_worker, round, first, last); ++round) {
+            for (Index i = first; i < last; ++i) {
+                (*m_body)(i);
+            }
+        }
+    }
+private:
+    LoopRange<Index> *m_range;
+    const Body *m_body;
+    int m_worker;
+};
+
+// A participant of parallelReduce(), folds map(i) of its chunks into
+// its own partial value
+template <typename Index, typename T, typename Map, typename Combine>
+class ReduceTask : public LoopTask
+{
+public:
+    ReduceTask():m_range(NULL), m_map(NULL), m_combine(NULL), m_worker(0), m_value() {}
+    void init(LoopRange<Index> *range, const Map *map, const Combine *combine,
+              int worker, const T &identity) {
+        m_range = range;
+        m_map = map;
+        m_combine = combine;
+        m_worker = worker;
+        m_value = identity;
+    }
+    const T& value() const { return m_value; }
+protected:
+    void runChunks() {
+        Index first, last;
+        for (int round = 0; m_range->next(m_worker, round, first, last); ++round) {
+            for (Index i = first; i < last; ++i) {
+                m_value = (*m_combine)(m_value, (*m_map)(i));
+            }
+        }
+    }
+private:
+    LoopRange<Index> *m_range;
+    const Map *m_map;
+    const Combine *m_combine;
+    int m_worker;
+    T m_value;
+};
+
+// Calls body(i) for every i in [begin, end) on the PoolThreads of pool
+// and the calling thread, returns once every call returned. grain <= 0
+// picks the grain automatically. May be called from a task of pool.
+// If a call threw, the other participants still finish their chunks,
+// then a TaskException with the first error is thrown; the indices
+// after the throwing one in its chunk are skipped.
+template <typename Index, typename Body>
+void parallelFor(ThreadPool &pool, Index begin, Index end, Index grain,
+                 const Body &body, int partition = Partition::DYNAMIC)
+{
+    if (!(begin < end)) {
+        return;
+    }
+    int workers = pool.concurrency() + 1;
+    if (workers > Partition::MAX_WORKERS) {
+        workers = Partition::MAX_WORKERS;
+    }
+    workers = LoopRange<Index>::participants(end - begin, grain, partition, workers);
+    LoopRange<Index> range(begin, end, grain, partition, workers);
+    ForTask<Index, Body> tasks[Partition::MAX_WORKERS];
+    for (int w = 0; w < workers; ++w) {
+        tasks[w].init(&range, &body, w);
+    }
+    // declared after the tasks, unwinding waits before they go away
+    TaskGroup group(pool);
+    for (int w = 1; w < workers; ++w) {
+        if (!group.execute(tasks[w])) {
+            // queue full, the caller takes over this share
+            tasks[w].run();
+        }
+    }
+    tasks[0].run();
+    group.wait();
+    rethrowFailure(tasks, workers);
+}
+
+// Folds map(i) for every i in [begin, end) with combine, starting from
+// identity. Partial results are combined in participant order, so a
+// combine that is associative but not commutative needs STATIC. Throws
+// like parallelFor() if a call of map or combine threw.
+template <typename Index, typename T, typename Map, typename Combine>
+T parallelReduce(ThreadPool &pool, Index begin, Index end, Index grain,
+                 const T &identity, const Map &map, const Combine &combine,
+                 int partition = Partition::DYNAMIC)
+{
+    if (!(begin < end)) {
+        return identity;
+    }
+    int workers = pool.concurrency() + 1;
+    if (workers > Partition::MAX_WORKERS) {
+        workers = Partition::MAX_WORKERS;
+    }
+    workers = LoopRange<Index>::participants(end - begin, grain, partition, workers);
+    LoopRange<Index> range(begin, end, grain, partition, workers);
+    ReduceTask<Index, T, Map, Combine> tasks[Partition::MAX_WORKERS];
+    for (int w = 0; w < workers; ++w) {
+        tasks[w].init(&range, &map, &combine, w, identity);
+    }
+    {
+        TaskGroup group(pool);
+        for (int w = 1; w < workers; ++w) {
+            if (!group.execute(tasks[w])) {
+                tasks[w].run();
+            }
+        }
+        tasks[0].run();
+        group.wait();
+    }
+    rethrowFailure(tasks, workers);
+    T result = tasks[0].value();
+    for (int w = 1; w < workers; ++w) {
+        result = combine(result, tasks[w].value());
+    }
+    return result;
+}
+
+} // namespace TTP
+#endif /* PARALLELFOR_H_ */
@@ -0,0 +1,115 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : PoolOptions.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef POOLOPTIONS_H_
+#define POOLOPTIONS_H_
+#include <vector>
+
+namespace TTP
+{
+
+// Construction parameters of a ThreadPool, the defaults describe a
+// FIFO pool with one PoolThread that may grow to four.
+class PoolOptions
+{
+public:
+    // engines of the shared task queue
+    // std::queue under the TaskPool lock, unbounded
+    static const int QUEUE_LOCKED = 0;
+    // lock-free ring of m_queueCapacity tasks, execute() fails when full
+    static const int QUEUE_RING = 1;
+    // engines of a priority pool
+    // a FIFO bucket per priority in [m_lowp, m_highp]
+    static const int PRIORITY_BUCKETS = 0;
+    // earliest Task::m_deadline first, m_priority is not looked at
+    static const int PRIORITY_DEADLINE = 1;
+    // m_multiQueueFactor heaps per PoolThread under their own locks,
+    // higher m_priority first but only approximately
+    static const int PRIORITY_MULTIQUEUE = 2;
+public:
+    PoolOptions()
+    :m_initThreads(1)
+    ,m_maxThreads(4)
+    ,m_lowp(-1)
+    ,m_highp(-1)
+    ,m_prioritypooling(false)
+    ,m_priorityEngine(PRIORITY_BUCKETS)
+    ,m_dropExpired(false)
+    ,m_multiQueueFactor(2)
+    ,m_reservedThreads(0)
+    ,m_reservedPriority(0)
+    ,m_keepAlive(60000)
+    ,m_growBacklog(16)
+    ,m_growAge(10)
+    ,m_queueEngine(QUEUE_LOCKED)
+    ,m_queueCapacity(65536)
+    ,m_functionSlots(1024)
+    ,m_timerSpin(0)
+    ,m_spinMicros(50)
+    ,m_numaAware(false)
+    {}
+public:
+    // PoolThreads started with the pool, they never retire
+    int m_initThreads;
+    // upper bound for the PoolThreads added under load
+    int m_maxThreads;
+    // priority range of a priority pool
+    int m_lowp;
+    int m_highp;
+    bool m_prioritypooling;
+    // one of the PRIORITY_* engines
+    int m_priorityEngine;
+    // a task taken off a priority pool's queue after its deadline
+    // passed is not run, see Task::expired()
+    bool m_dropExpired;
+    // PRIORITY_MULTIQUEUE only: heaps per m_maxThreads
+    int m_multiQueueFactor;
+    // PRIORITY_BUCKETS only: per round dispatch shares of the priorities m_lowp upwards, 0
+    // for unlimited; empty runs the highest priority first, always
+    std::vector<int> m_weights;
+    // PRIORITY_BUCKETS only: the first m_reservedThreads PoolThreads run
+    // tasks of m_reservedPriority and above, and lower ones only when
+    // marked Task::m_short; at most m_initThreads - 1 are reserved
+    int m_reservedThreads;
+    int m_reservedPriority;
+    // milliseconds a surplus PoolThread stays parked before it retires
+    long m_keepAlive;
+    // a PoolThread is added when no thread is parked and this many
+    // tasks are queued ...
+    int m_growBacklog;
+    // ... or the queue has not been served for this many milliseconds,
+    // 0 disables the check
+    long m_growAge;
+    // one of the QUEUE_* engines, priority pools always use the lock
+    int m_queueEngine;
+    long m_queueCapacity;
+    // tasks set aside for functors queued with execute(const F&), allocated
+    // with the first one; more functors in flight than this are heap allocated
+    long m_functionSlots;
+    // nanoseconds the timer thread spins before a deadline, a value
+    // above 0 selects the precision timer: a timerfd armed for the
+    // deadline minus the spin, then a busy wait on the clock. Linux
+    // only, elsewhere and by default the timer sleeps on a condition.
+    long m_timerSpin;
+    // microseconds an idle PoolThread spins for new work before it
+    // parks, halved after each spin in vain and doubled after each
+    // one that found work; 0 parks at once
+    long m_spinMicros;
+    // CPUs the PoolThreads are pinned to, empty lets them float;
+    // CPUs the process may not use are ignored
+    std::vector<int> m_cpus;
+    // spreads the PoolThreads over the NUMA nodes of Topology, each
+    // pinned to its node's CPUs of m_cpus. A pool without priorities
+    // also gets a queue per node: tasks queued from a node, or for one
+    // with ThreadPool::executeOn(), are run and stolen by the threads
+    // of that node first
+    bool m_numaAware;
+};
+
+} // namespace TTP
+
+#endif /* POOLOPTIONS_H_ */
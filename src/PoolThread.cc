@@ -9,116 +9,148 @@
 #include <exception>
 #include <assert.h>
 #include "PoolThread.h"
+#include "Atomic.h"
+#include "ThreadPool.h"
 
 namespace TTP
 {
 
+// slots of ThreadPool::m_workers lie sizeof(PoolThread) apart, each
+// has to start a cache line of its own
+typedef char PoolThreadStrideCheck[sizeof(PoolThread) % PoolThread::CACHELINE == 0 ? 1 : -1];
+
+namespace
+{
+    pthread_key_t currentKey;
+    pthread_once_t currentOnce = PTHREAD_ONCE_INIT;
+} // namespace anonymous
+
+void PoolThread::createKey()
+{
+	pthread_key_create(&currentKey, NULL);
+}
+
+PoolThread* PoolThread::current()
+{
+	pthread_once(&currentOnce, &PoolThread::createKey);
+	return static_cast<PoolThread*>(pthread_getspecific(currentKey));
+}
+
 void* PoolThread::run(void *arg)
 {
 	PoolThread* ths = static_cast<PoolThread*>(arg);
 	assert(ths != NULL);
-	ths->m_mutex->lock();
-	bool fl = ths->m_runFlag;
-	ths->m_mutex->unlock();
-	while (fl) {
-		ths->m_thread->wait();
-		Task* task = ths->getTask();
-		if (task != NULL) {
-			try {
-				task->run();
-			}
-			catch(std::exception &e) {
-		        std::cerr << e.what() << std::endl;
+	pthread_once(&currentOnce, &PoolThread::createKey);
+	pthread_setspecific(currentKey, ths);
+	// take() blocks on the task queue and returns NULL once the pool
+	// stops or the thread retires
+	Task* task = ths->m_pool->take(ths);
+	while (task != NULL) {
+		// the task may delete itself, its continuations are taken first
+		Successor *successors = task->m_successors;
+		task->m_successors = NULL;
+		long long deadline = task->m_deadline;
+		try {
+			if (task->m_invoke != NULL) {
+				task->m_invoke(task);
 			}
-			catch(...) {
-			    std::cerr << "pool thread catch exception !" << std::endl;
+			else {
+				task->run();
 			}
-			ths->release();
 		}
-		ths->m_mutex->lock();
-		fl = ths->m_runFlag;
-		ths->m_mutex->unlock();
+		catch(std::exception &e) {
+	        std::cerr << e.what() << std::endl;
+		}
+		catch(...) {
+		    std::cerr << "pool thread catch exception !" << std::endl;
+		}
+		// the task may be gone already, only the pool is told; the
+		// continuations are queued before the task stops counting
+		if (deadline >= 0 && Timer::getCurrentTime() > deadline) {
+			atomicAdd(&ths->m_pool->m_deadlineMisses, 1LL);
+		}
+		if (successors != NULL) {
+			ths->m_pool->resume(successors);
+		}
+		ths->m_pool->finished();
+		task = ths->m_pool->take(ths);
 	}
-	ths->m_mutex->lock();
-	ths->m_complete = true;
-	ths->m_mutex->unlock();
 	return NULL;
 }
 
-PoolThread::PoolThread()
+PoolThread::PoolThread(ThreadPool *pool)
 {
-    m_task = NULL;
-    m_idle = true;
-    m_complete = false;
-    m_runFlag = true;
+    // busy until its first look at the queues
+    m_state = RUNNING;
+    m_nextIdle = 0;
+    m_stacked = 0;
+    m_pool = pool;
+    m_deque = new WorkStealingDeque;
+    m_node = 0;
+    m_reserved = false;
+    m_thread = new Thread(&PoolThread::run, this);
     m_thrdStarted = false;
-	m_mutex = new Mutex;
-	m_thread = new Thread(&PoolThread::run, this);
+    m_seed = static_cast<unsigned int>(reinterpret_cast<size_t>(this) >> 4) | 1;
+    m_spinBudget = pool->m_spinNanos;
+    m_task = NULL;
 }
 
 PoolThread::~PoolThread()
 {
-    m_runFlag = false;
-	m_mutex->lock();
-	bool fl = m_complete;
-	m_mutex->unlock();
-	while(!fl) {
-		m_mutex->lock();
-		fl = m_complete;
-		m_mutex->unlock();
-		m_thread->interrupt();
-		Thread::mSleep(1);
-	}
+	// the owning pool has stopped, the thread leaves take() on its own
+	m_thread->join();
 	delete m_thread;
-	delete m_mutex;
+	delete m_deque;
 }
 
 void PoolThread::execute()
 {
+	// called under the TaskPool lock
 	if(m_thrdStarted) {
 	    return;
 	}
-	m_mutex->lock();
 	m_thread->execute();
 	m_thrdStarted = true;
-	m_mutex->unlock();
 }
 
 void PoolThread::checkout(Task *task)
 {
-	m_mutex->lock();
-	m_idle = false;
-	m_task = task;
-	if(m_thrdStarted) {
-		this->m_thread->interrupt();
+	atomicStore(&m_task, task, __ATOMIC_RELAXED);
+}
+
+bool PoolThread::claim()
+{
+	int expected = IDLE;
+	if (!atomicCas(&m_state, expected, ASSIGNED)) {
+		return false;
 	}
-	m_mutex->unlock();
+	m_parking.notify();
+	return true;
 }
 
-void PoolThread::release()
+int PoolThread::state() const
 {
-	m_mutex->lock();
-	m_task = NULL;
-	m_idle = true;
-	m_mutex->unlock();
+	return atomicLoad(&m_state, __ATOMIC_ACQUIRE);
 }
 
-bool PoolThread::isIdle()
+bool PoolThread::isIdle() const
 {
-    bool idle = false;
-	m_mutex->lock();
-	idle = m_idle;
-	m_mutex->unlock();
-	return idle;
+	int current = state();
+	return current == IDLE || current == ASSIGNED;
 }
 
-Task* PoolThread::getTask()
+unsigned int PoolThread::nextRandom()
 {
-	m_mutex->lock();
-	Task* task = m_task;
-	m_mutex->unlock();
-	return task;
+	// xorshift32, only touched by the owning thread
+	m_seed ^= m_seed << 13;
+	m_seed ^= m_seed >> 17;
+	m_seed ^= m_seed << 5;
+	return m_seed;
 }
 
-} // namespace TTP
+Task* PoolThread::getTask() const
+{
+	return atomicLoad(&m_task, __ATOMIC_RELAXED);
+}
 
+} // namespace TTP
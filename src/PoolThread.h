@@ -9,30 +9,81 @@
 #define POOLTHREAD_H_
 #include "Task.h"
 #include "Thread.h"
-#include "Mutex.h"
+#include "EventCount.h"
 #include "TimeUnit.h"
+#include "WorkStealingDeque.h"
 
 namespace TTP
 {
 
-class PoolThread
+class ThreadPool;
+
+// A worker of a ThreadPool. The pool keeps its PoolThreads in one
+// contiguous array of cache line aligned slots, the fields other
+// threads write apart from those of the thread itself. Other threads
+// only look at the state word: a producer pops an IDLE PoolThread off
+// the idle stack, claims it with a single CAS and wakes it on its own
+// EventCount.
+class __attribute__((aligned(64))) PoolThread
 {
     friend class ThreadPool;
 public:
-    PoolThread();
+    // the alignment and a divisor of the size of a PoolThread
+    enum { CACHELINE = 64 };
+    // parked, or about to park, and free to be claimed
+    static const int IDLE = 0;
+    // claimed by a producer that queued work for it, not yet awake
+    static const int ASSIGNED = 1;
+    // looking for or running tasks
+    static const int RUNNING = 2;
+    // retired after its keep-alive or stopped with the pool, the
+    // slot may be restarted
+    static const int STOPPING = 3;
+public:
+    PoolThread(ThreadPool *pool);
     virtual ~PoolThread();
-	bool isIdle();
+	bool isIdle() const;
+	// records the task the thread runs, called by the thread itself
 	void checkout(Task *task);
 	void execute();
-    void release();
-    Task* getTask();
+    Task* getTask() const;
+    int state() const;
     static void* run(void *arg);
+    // the PoolThread running the calling thread, NULL for foreign threads
+    static PoolThread* current();
+private:
+    // IDLE to ASSIGNED and a wake-up, false if the thread was not IDLE
+    bool claim();
+    // next pseudo random number, used to pick steal victims
+    unsigned int nextRandom();
+    static void createKey();
 private:
+    // written by claiming producers and the thread itself
+    volatile int m_state;
+    // slot + 1 of the PoolThread below this one on its node's idle
+    // stack, 0 at the bottom
+    volatile unsigned int m_nextIdle;
+    // 1 while an entry of the thread is on the idle stack, see
+    // ThreadPool::pushIdle()
+    volatile int m_stacked;
+    // the thread parks on it while IDLE
+    EventCount m_parking;
+    char m_pad1[CACHELINE];
+    ThreadPool *m_pool;
+    // tasks submitted from this thread, other PoolThreads steal from it
+    WorkStealingDeque *m_deque;
+    // NUMA node of the thread, see PoolOptions::m_numaAware
+    int m_node;
+    // runs tasks below the reserved priority only if they are short,
+    // see PoolOptions::m_reservedThreads
+    bool m_reserved;
     Thread *m_thread;
-    bool m_idle;
-    Task *m_task;
-    Mutex *m_mutex;
-    volatile bool m_runFlag, m_complete, m_thrdStarted;
+    volatile bool m_thrdStarted;
+    // from here on only touched by the thread itself
+    unsigned int m_seed;
+    // current spin before parking, see ThreadPool::spin()
+    long long m_spinBudget;
+    Task * volatile m_task;
 };
 
 } // namespace TTP
@@ -0,0 +1,322 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : PriorityQueue.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "Timer.h"
+#include "PriorityQueue.h"
+
+namespace TTP
+{
+
+// ranges above MAX_LEVELS are cut off at lowp + MAX_LEVELS - 1
+static long levelCount(int lowp, int highp)
+{
+    long levels = highp < lowp ? 1 : static_cast<long>(highp) - lowp + 1;
+    return levels > PriorityQueue::MAX_LEVELS ? PriorityQueue::MAX_LEVELS : levels;
+}
+
+PriorityQueue::LevelSet::LevelSet(long levels)
+{
+    m_layers = 0;
+    long bits = levels;
+    do {
+        long words = (bits + 63) / 64;
+        m_bits[m_layers] = new unsigned long long[words];
+        memset(m_bits[m_layers], 0, words * sizeof(unsigned long long));
+        m_words[m_layers] = words;
+        ++m_layers;
+        bits = words;
+    } while (bits > 1);
+}
+
+PriorityQueue::LevelSet::~LevelSet()
+{
+    for (int i = 0; i < m_layers; ++i) {
+        delete[] m_bits[i];
+    }
+}
+
+void PriorityQueue::LevelSet::mark(long level)
+{
+    for (int layer = 0; layer < m_layers; ++layer) {
+        unsigned long long &word = m_bits[layer][level >> 6];
+        bool wasEmpty = word == 0;
+        word |= 1ULL << (level & 63);
+        if (!wasEmpty) {
+            // the layers above already know of this word
+            break;
+        }
+        level >>= 6;
+    }
+}
+
+void PriorityQueue::LevelSet::unmark(long level)
+{
+    for (int layer = 0; layer < m_layers; ++layer) {
+        unsigned long long &word = m_bits[layer][level >> 6];
+        word &= ~(1ULL << (level & 63));
+        if (word != 0) {
+            break;
+        }
+        level >>= 6;
+    }
+}
+
+long PriorityQueue::LevelSet::top() const
+{
+    // descend from the single top word along the highest set bits
+    long index = 0;
+    for (int layer = m_layers - 1; layer >= 0; --layer) {
+        unsigned long long word = m_bits[layer][index];
+        index = index * 64 + (63 - __builtin_clzll(word));
+    }
+    return index;
+}
+
+bool PriorityQueue::LevelSet::empty() const
+{
+    return m_bits[m_layers - 1][0] == 0;
+}
+
+void PriorityQueue::LevelSet::assign(const LevelSet &other)
+{
+    clear(m_layers - 1, 0);
+    copy(other, m_layers - 1, 0);
+}
+
+void PriorityQueue::LevelSet::clear(int layer, long index)
+{
+    unsigned long long word = m_bits[layer][index];
+    m_bits[layer][index] = 0;
+    while (layer > 0 && word != 0) {
+        clear(layer - 1, index * 64 + __builtin_ctzll(word));
+        word &= word - 1;
+    }
+}
+
+void PriorityQueue::LevelSet::copy(const LevelSet &other, int layer, long index)
+{
+    unsigned long long word = other.m_bits[layer][index];
+    m_bits[layer][index] = word;
+    while (layer > 0 && word != 0) {
+        copy(other, layer - 1, index * 64 + __builtin_ctzll(word));
+        word &= word - 1;
+    }
+}
+
+PriorityQueue::PriorityQueue(int lowp, int highp)
+:m_ready(levelCount(lowp, highp))
+,m_eligible(levelCount(lowp, highp))
+,m_shortReady(levelCount(lowp, highp))
+{
+    m_lowp = lowp;
+    m_levels = levelCount(lowp, highp);
+    m_highp = static_cast<int>(lowp + m_levels - 1);
+    m_buckets = new Bucket[m_levels];
+    for (long i = 0; i < m_levels; ++i) {
+        for (int list = 0; list < LISTS; ++list) {
+            m_buckets[i].m_head[list] = NULL;
+            m_buckets[i].m_tail[list] = NULL;
+        }
+        m_buckets[i].m_weight = 0;
+        m_buckets[i].m_credit = 0;
+        m_buckets[i].m_round = 0;
+    }
+    m_weighted = false;
+    m_reservedLevel = m_levels;
+    m_round = 1;
+    m_size = 0;
+}
+
+PriorityQueue::~PriorityQueue()
+{
+    delete[] m_buckets;
+}
+
+void PriorityQueue::setWeights(const std::vector<int> &weights)
+{
+    m_weighted = false;
+    for (long i = 0; i < m_levels; ++i) {
+        int weight = 0;
+        if (i < static_cast<long>(weights.size()) && weights[i] > 0) {
+            weight = weights[i];
+            m_weighted = true;
+        }
+        m_buckets[i].m_weight = weight;
+    }
+}
+
+void PriorityQueue::setReserved(int priority)
+{
+    m_reservedLevel = static_cast<long>(clamp(priority)) - m_lowp;
+}
+
+bool PriorityQueue::reserving() const
+{
+    return m_reservedLevel < m_levels;
+}
+
+bool PriorityQueue::reservable(const Task *task) const
+{
+    if (!reserving()) {
+        return false;
+    }
+    return task->m_short || static_cast<long>(clamp(task->m_priority)) - m_lowp >= m_reservedLevel;
+}
+
+int PriorityQueue::clamp(int priority) const
+{
+    if (priority < m_lowp) {
+        return m_lowp;
+    }
+    if (priority > m_highp) {
+        return m_highp;
+    }
+    return priority;
+}
+
+bool PriorityQueue::hasCredit(const Bucket &bucket) const
+{
+    // credit not yet touched in this round is a full weight
+    return bucket.m_weight == 0 || bucket.m_round != m_round || bucket.m_credit > 0;
+}
+
+void PriorityQueue::push(Task *task)
+{
+    long level = static_cast<long>(clamp(task->m_priority)) - m_lowp;
+    Bucket &bucket = m_buckets[level];
+    int list = task->m_short && level < m_reservedLevel ? SHORT : REGULAR;
+    bool wasEmpty = bucket.m_head[REGULAR] == NULL && bucket.m_head[SHORT] == NULL;
+    task->m_link = NULL;
+    task->m_queuedAt = Timer::getCurrentTime();
+    if (bucket.m_tail[list] != NULL) {
+        bucket.m_tail[list]->m_link = task;
+    }
+    else {
+        bucket.m_head[list] = task;
+        if (list == SHORT) {
+            m_shortReady.mark(level);
+        }
+    }
+    bucket.m_tail[list] = task;
+    if (wasEmpty) {
+        m_ready.mark(level);
+        if (m_weighted && hasCredit(bucket)) {
+            m_eligible.mark(level);
+        }
+    }
+    ++bucket.m_stats.m_queued;
+    ++m_size;
+}
+
+Task* PriorityQueue::pop(bool reserved)
+{
+    if (m_size == 0) {
+        return NULL;
+    }
+    if (reserved) {
+        // strict priority within the reserved band, the shares are
+        // kept by the regular threads
+        long level = m_ready.top();
+        if (level >= m_reservedLevel) {
+            return take(level, REGULAR);
+        }
+        if (m_shortReady.empty()) {
+            return NULL;
+        }
+        return take(m_shortReady.top(), SHORT);
+    }
+    long level;
+    if (m_weighted) {
+        if (m_eligible.empty()) {
+            // every waiting level spent its credit, start a new round
+            ++m_round;
+            m_eligible.assign(m_ready);
+        }
+        level = m_eligible.top();
+    }
+    else {
+        level = m_ready.top();
+    }
+    // FIFO across both lists of the level
+    const Bucket &bucket = m_buckets[level];
+    int list = REGULAR;
+    if (bucket.m_head[REGULAR] == NULL || (bucket.m_head[SHORT] != NULL
+            && bucket.m_head[SHORT]->m_queuedAt < bucket.m_head[REGULAR]->m_queuedAt)) {
+        list = SHORT;
+    }
+    return take(level, list);
+}
+
+Task* PriorityQueue::take(long level, int list)
+{
+    Bucket &bucket = m_buckets[level];
+    Task *task = bucket.m_head[list];
+    bucket.m_head[list] = task->m_link;
+    if (bucket.m_head[list] == NULL) {
+        bucket.m_tail[list] = NULL;
+        if (list == SHORT) {
+            m_shortReady.unmark(level);
+        }
+    }
+    if (bucket.m_weight > 0) {
+        if (bucket.m_round != m_round) {
+            bucket.m_round = m_round;
+            bucket.m_credit = bucket.m_weight;
+        }
+        if (--bucket.m_credit == 0) {
+            m_eligible.unmark(level);
+        }
+    }
+    if (bucket.m_head[REGULAR] == NULL && bucket.m_head[SHORT] == NULL) {
+        m_ready.unmark(level);
+        if (m_weighted) {
+            m_eligible.unmark(level);
+        }
+    }
+    task->m_link = NULL;
+    long long wait = Timer::getCurrentTime() - task->m_queuedAt;
+    PriorityStats &stats = bucket.m_stats;
+    --stats.m_queued;
+    ++stats.m_dispatched;
+    stats.m_waitNanos += wait;
+    if (wait > stats.m_maxWaitNanos) {
+        stats.m_maxWaitNanos = wait;
+    }
+    --m_size;
+    return task;
+}
+
+bool PriorityQueue::empty() const
+{
+    return m_size == 0;
+}
+
+bool PriorityQueue::ready(bool reserved) const
+{
+    if (!reserved || m_size == 0) {
+        return m_size > 0;
+    }
+    return m_ready.top() >= m_reservedLevel || !m_shortReady.empty();
+}
+
+long PriorityQueue::size() const
+{
+    return m_size;
+}
+
+bool PriorityQueue::stats(int priority, PriorityStats &stats) const
+{
+    if (priority < m_lowp || priority > m_highp) {
+        return false;
+    }
+    stats = m_buckets[priority - m_lowp].m_stats;
+    return true;
+}
+
+} // namespace TTP
@@ -0,0 +1,147 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : PriorityQueue.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef PRIORITYQUEUE_H_
+#define PRIORITYQUEUE_H_
+#include <vector>
+#include "Task.h"
+
+namespace TTP
+{
+
+// Dispatch counters of one priority level, see ThreadPool::priorityStats()
+class PriorityStats
+{
+public:
+    PriorityStats()
+    :m_queued(0)
+    ,m_dispatched(0)
+    ,m_waitNanos(0)
+    ,m_maxWaitNanos(0)
+    {}
+    // tasks waiting at this level now
+    long m_queued;
+    // tasks taken off this level so far
+    long long m_dispatched;
+    // sum and maximum of the time those tasks spent queued
+    long long m_waitNanos;
+    long long m_maxWaitNanos;
+};
+
+// Ready queue of a priority pool: one FIFO bucket per priority in
+// [lowp, highp], chained through the tasks themselves, and a bitmap of
+// the non-empty buckets, one bit per bucket and one per word of the
+// layer below, so push() and pop() are O(1). Not thread safe, the
+// TaskPool guards it with its mutex. A task must not be queued twice
+// at the same time.
+//
+// Without weights the highest non-empty level always wins. With
+// weights, dispatch runs in rounds: a level may hand out as many tasks
+// per round as its weight, the highest level with credit left goes
+// first, and a new round starts once every non-empty level used up its
+// credit, so low levels keep their share under sustained high traffic.
+//
+// With a reserved priority, short tasks below it are kept apart so the
+// reserved PoolThreads find them without looking at the others.
+class PriorityQueue
+{
+public:
+    // largest supported highp - lowp + 1
+    static const long MAX_LEVELS = 65536;
+    PriorityQueue(int lowp, int highp);
+    ~PriorityQueue();
+    // weights[i] is the share of priority lowp + i, 0 or a missing
+    // entry leaves the level unlimited; an empty vector keeps strict
+    // priority order. Only while the queue is empty.
+    void setWeights(const std::vector<int> &weights);
+    // reserved threads take tasks of priority and above, lower ones
+    // only when marked Task::m_short. Only while the queue is empty.
+    void setReserved(int priority);
+    bool reserving() const;
+    // whether a reserved thread may take task
+    bool reservable(const Task *task) const;
+    // priorities outside [lowp, highp] are clamped to the range
+    void push(Task *task);
+    // the oldest task of the level picked as described above, NULL if
+    // empty. A reserved thread gets the highest task of the reserved
+    // priorities, else the highest short one, else NULL.
+    Task* pop(bool reserved = false);
+    bool empty() const;
+    // whether pop(reserved) would return a task
+    bool ready(bool reserved) const;
+    long size() const;
+    int clamp(int priority) const;
+    // false if priority is outside [lowp, highp]
+    bool stats(int priority, PriorityStats &stats) const;
+private:
+    // layered bitmap of levels
+    class LevelSet
+    {
+    public:
+        explicit LevelSet(long levels);
+        ~LevelSet();
+        void mark(long level);
+        void unmark(long level);
+        // the highest marked level, the set must not be empty
+        long top() const;
+        bool empty() const;
+        // walks the summary words of both sets, so it costs the
+        // non-empty words rather than levels / 64
+        void assign(const LevelSet &other);
+    private:
+        LevelSet(const LevelSet&);
+        LevelSet& operator = (const LevelSet&);
+        // zeroes, or copies from other, the word at index of layer and
+        // the words below it that its bits mark
+        void clear(int layer, long index);
+        void copy(const LevelSet &other, int layer, long index);
+        // 64^3 bits cover MAX_LEVELS
+        enum { LAYERS = 3 };
+        // m_bits[0] has a bit per level, the last layer is a single word
+        unsigned long long *m_bits[LAYERS];
+        long m_words[LAYERS];
+        int m_layers;
+    };
+    // the task lists of a bucket, SHORT only below the reserved level
+    enum { REGULAR = 0, SHORT = 1, LISTS = 2 };
+    struct Bucket
+    {
+        Task *m_head[LISTS];
+        Task *m_tail[LISTS];
+        // 0 for unlimited, credit is only valid in round m_round
+        int m_weight;
+        int m_credit;
+        unsigned long m_round;
+        PriorityStats m_stats;
+    };
+private:
+    PriorityQueue(const PriorityQueue&);
+    PriorityQueue& operator = (const PriorityQueue&);
+    bool hasCredit(const Bucket &bucket) const;
+    // unlinks the head of list at level and books its dispatch
+    Task* take(long level, int list);
+private:
+    int m_lowp;
+    int m_highp;
+    long m_levels;
+    Bucket *m_buckets;
+    // non-empty levels
+    LevelSet m_ready;
+    // non-empty levels with credit left in this round, only kept
+    // when weighted
+    LevelSet m_eligible;
+    bool m_weighted;
+    // levels whose SHORT list is not empty
+    LevelSet m_shortReady;
+    // levels from m_reservedLevel up are reserved, m_levels for none
+    long m_reservedLevel;
+    unsigned long m_round;
+    long m_size;
+};
+
+} // namespace TTP
+#endif /* PRIORITYQUEUE_H_ */
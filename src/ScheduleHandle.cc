@@ -0,0 +1,57 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : ScheduleHandle.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#include "ScheduleHandle.h"
+#include "ThreadPool.h"
+
+namespace TTP
+{
+
+ScheduleHandle::ScheduleHandle()
+{
+    m_pool = NULL;
+    m_entry = NULL;
+    m_generation = 0;
+}
+
+ScheduleHandle::ScheduleHandle(ThreadPool *pool, TimerEntry *entry, unsigned int generation)
+{
+    m_pool = pool;
+    m_entry = entry;
+    m_generation = generation;
+}
+
+bool ScheduleHandle::cancel()
+{
+    if (m_entry == NULL) {
+        return false;
+    }
+    return m_pool->cancel(m_entry, m_generation);
+}
+
+bool ScheduleHandle::reschedule(long long tunit, int type)
+{
+    if (m_entry == NULL) {
+        return false;
+    }
+    return m_pool->reschedule(m_entry, m_generation, tunit, type);
+}
+
+bool ScheduleHandle::isPending() const
+{
+    if (m_entry == NULL) {
+        return false;
+    }
+    return m_pool->isPending(m_entry, m_generation);
+}
+
+bool ScheduleHandle::isEmpty() const
+{
+    return m_entry == NULL;
+}
+
+} // namespace TTP
@@ -0,0 +1,46 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : ScheduleHandle.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef SCHEDULEHANDLE_H_
+#define SCHEDULEHANDLE_H_
+#include <cstddef>
+
+namespace TTP
+{
+
+class ThreadPool;
+class TimerEntry;
+
+// Returned by ThreadPool::schedule(), refers to the timer entry of one
+// scheduled task. The entry's generation changes once the task is due,
+// cancelled or the entry reused, a stale handle then does nothing.
+// Copies refer to the same entry. Must not outlive the pool.
+class ScheduleHandle
+{
+    friend class ThreadPool;
+public:
+    ScheduleHandle();
+    // withdraws the task if it is still waiting for its delay, in O(1);
+    // returns false if it was already handed to a PoolThread
+    bool cancel();
+    // restarts the delay of a waiting task from now, in O(1);
+    // returns false if it was already handed to a PoolThread
+    bool reschedule(long long tunit, int type);
+    // true while the task waits for its delay
+    bool isPending() const;
+    // true for a task that did not go to the timer
+    bool isEmpty() const;
+private:
+    ScheduleHandle(ThreadPool *pool, TimerEntry *entry, unsigned int generation);
+private:
+    ThreadPool *m_pool;
+    TimerEntry *m_entry;
+    unsigned int m_generation;
+};
+
+} // namespace TTP
+#endif /* SCHEDULEHANDLE_H_ */
@@ -15,6 +15,13 @@ Task::Task()
     m_tunit = -1;
     m_type = -1;
     m_priority = -1;
+    m_successors = NULL;
+    m_invoke = NULL;
+    m_link = NULL;
+    m_short = false;
+    m_deadline = -1;
+    m_heapIndex = -1;
+    m_queuedAt = 0;
 }
 
 Task::Task(int priority)
@@ -22,6 +29,13 @@ Task::Task(int priority)
     m_tunit = -1;
     m_type = -1;
     m_priority = priority;
+    m_successors = NULL;
+    m_invoke = NULL;
+    m_link = NULL;
+    m_short = false;
+    m_deadline = -1;
+    m_heapIndex = -1;
+    m_queuedAt = 0;
 }
 
 Task::Task(int tunit, int type)
@@ -29,12 +43,23 @@ Task::Task(int tunit, int type)
     m_tunit = tunit;
     m_type = type;
     m_priority = -1;
+    m_successors = NULL;
+    m_invoke = NULL;
+    m_link = NULL;
+    m_short = false;
+    m_deadline = -1;
+    m_heapIndex = -1;
+    m_queuedAt = 0;
 }
 
 Task::~Task()
 {
 }
 
+void Task::expired()
+{
+}
+
 bool Task::isWaitOver(Timer *timer)
 {
 	bool flag = false;
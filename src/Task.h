@@ -10,6 +10,7 @@
 #include "string"
 #include "Timer.h"
 #include "TimeUnit.h"
+#include "Continuation.h"
 
 namespace TTP
 {
@@ -19,17 +20,43 @@ class Task
 	friend class PoolThread;
 	friend class ThreadPool;
 	friend class TaskPool;
+	friend class FunctionTask;
+	friend class PriorityQueue;
+	friend class DeadlineQueue;
+	friend class TaskGroup;
 public:
 	Task();
     Task(int priority);
     Task(int tunit, int type);
 	virtual ~Task();
 	virtual void run() = 0;
+	// called instead of run() when a pool dropped the task because
+	// its deadline passed, the pool no longer touches it afterwards
+	virtual void expired();
     bool isWaitOver(Timer *timer);
 public:
     int m_tunit;
     int m_type;
     int m_priority;
+    // quick to run, reserved PoolThreads of a priority pool may take
+    // it below their reserved priority
+    bool m_short;
+    // absolute Timer::getCurrentTime() the task should have finished
+    // by, -1 for none; set by ThreadPool::executeWithin()
+    long long m_deadline;
+private:
+    // continuations attached with ThreadPool::then(), whenAll() and
+    // whenAny(), taken by the PoolThread before it runs the task
+    Successor *volatile m_successors;
+    // set for tasks that are called through a function pointer
+    // instead of run(), see FunctionTask
+    void (*m_invoke)(Task*);
+    // next task of the same PriorityQueue bucket
+    Task *m_link;
+    // Timer::getCurrentTime() of the push into a PriorityQueue
+    long long m_queuedAt;
+    // position in a DeadlineQueue, -1 while not queued there
+    long m_heapIndex;
 };
 
 } // namespace TTP
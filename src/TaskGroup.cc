@@ -0,0 +1,238 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : TaskGroup.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#include <iostream>
+#include <exception>
+#include <new>
+#include "Atomic.h"
+#include "TaskGroup.h"
+#include "ThreadPool.h"
+
+namespace TTP
+{
+
+TaskGroup::GroupTask* TaskGroup::GroupTask::create(TaskGroup *group, Task *task,
+        FunctionSlots *slots)
+{
+    void *block = slots != NULL ? slots->allocate(sizeof(GroupTask)) : NULL;
+    if (block == NULL) {
+        return new GroupTask(group, task);
+    }
+    GroupTask *proxy = new (block) GroupTask(group, task);
+    proxy->m_slots = slots;
+    return proxy;
+}
+
+TaskGroup::GroupTask::GroupTask(TaskGroup *group, Task *task)
+{
+    m_slots = NULL;
+    m_group = group;
+    m_task = task;
+    m_state = QUEUED;
+    m_refs = 2;
+    // scheduled like the task itself
+    m_short = task->m_short;
+    m_deadline = task->m_deadline;
+}
+
+void TaskGroup::GroupTask::run()
+{
+    if (claim()) {
+        execute();
+        m_group->finished();
+    }
+    // a waiter or cancelPending() may have taken the task,
+    // the queue reference is dropped either way
+    release();
+}
+
+void TaskGroup::GroupTask::expired()
+{
+    if (claim()) {
+        execute(true);
+        m_group->finished();
+    }
+    release();
+}
+
+bool TaskGroup::GroupTask::claim()
+{
+    int state = QUEUED;
+    return atomicCas(&m_state, state, static_cast<int>(CLAIMED));
+}
+
+bool TaskGroup::GroupTask::cancel()
+{
+    int state = QUEUED;
+    return atomicCas(&m_state, state, static_cast<int>(CANCELLED));
+}
+
+bool TaskGroup::GroupTask::isQueued()
+{
+    return atomicLoad(&m_state, __ATOMIC_RELAXED) == QUEUED;
+}
+
+void TaskGroup::GroupTask::execute(bool expired)
+{
+    // the task may delete itself, its continuations are taken first
+    Successor *successors = m_task->m_successors;
+    m_task->m_successors = NULL;
+    try {
+        if (expired) {
+            m_task->expired();
+        }
+        else {
+            m_task->run();
+        }
+    }
+    catch(std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
+    catch(...) {
+        std::cerr << "task group catch exception !" << std::endl;
+    }
+    if (successors != NULL) {
+        m_group->m_pool.resume(successors);
+    }
+}
+
+void TaskGroup::GroupTask::retain()
+{
+    atomicAdd(&m_refs, 1);
+}
+
+void TaskGroup::GroupTask::release()
+{
+    if (atomicSub(&m_refs, 1) == 0) {
+        FunctionSlots *slots = m_slots;
+        if (slots == NULL) {
+            delete this;
+            return;
+        }
+        this->~GroupTask();
+        slots->deallocate(this, sizeof(GroupTask));
+    }
+}
+
+TaskGroup::TaskGroup(ThreadPool &pool)
+:m_pool(pool)
+,m_pending(0)
+,m_waiters(0)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    wait();
+}
+
+bool TaskGroup::execute(Task *task)
+{
+    return execute(task, -1);
+}
+
+bool TaskGroup::execute(Task &task)
+{
+    return execute(&task, -1);
+}
+
+bool TaskGroup::execute(Task *task, int priority)
+{
+    if (task == NULL) {
+        return false;
+    }
+    GroupTask *proxy = GroupTask::create(this, task, m_pool.m_functions);
+    m_cond.lock();
+    m_tasks.push_back(proxy);
+    ++m_pending;
+    m_cond.unlock();
+    proxy->m_tunit = -1;
+    proxy->m_type = -1;
+    proxy->m_priority = priority;
+    if (!m_pool.enqueue(proxy)) {
+        proxy->cancel();
+        proxy->release();
+        finished();
+        return false;
+    }
+    m_cond.lock();
+    if (m_waiters > 0) {
+        // let a waiter pick up work submitted from inside the group
+        m_cond.broadcast();
+    }
+    m_cond.unlock();
+    return true;
+}
+
+void TaskGroup::finished()
+{
+    m_cond.lock();
+    if (--m_pending == 0) {
+        m_cond.broadcast();
+    }
+    m_cond.unlock();
+}
+
+void TaskGroup::wait()
+{
+    size_t next = 0;
+    m_cond.lock();
+    while (m_pending > 0) {
+        GroupTask *proxy = NULL;
+        while (next < m_tasks.size() && proxy == NULL) {
+            if (m_tasks[next]->isQueued()) {
+                proxy = m_tasks[next];
+            }
+            ++next;
+        }
+        if (proxy != NULL) {
+            // another waiter may clear the group once the proxy ran
+            proxy->retain();
+            m_cond.unlock();
+            if (proxy->claim()) {
+                proxy->execute();
+                finished();
+            }
+            proxy->release();
+            m_cond.lock();
+        }
+        else {
+            ++m_waiters;
+            m_cond.wait();
+            --m_waiters;
+        }
+    }
+    clear();
+    m_cond.unlock();
+}
+
+size_t TaskGroup::cancelPending()
+{
+    size_t cancelled = 0;
+    m_cond.lock();
+    for (size_t i = 0; i < m_tasks.size(); ++i) {
+        if (m_tasks[i]->cancel()) {
+            ++cancelled;
+            --m_pending;
+        }
+    }
+    if (cancelled > 0 && m_pending == 0) {
+        m_cond.broadcast();
+    }
+    m_cond.unlock();
+    return cancelled;
+}
+
+void TaskGroup::clear()
+{
+    for (size_t i = 0; i < m_tasks.size(); ++i) {
+        m_tasks[i]->release();
+    }
+    m_tasks.clear();
+}
+
+} // namespace TTP
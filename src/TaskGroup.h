@@ -0,0 +1,88 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : TaskGroup.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef TASKGROUP_H_
+#define TASKGROUP_H_
+#include <vector>
+#include "Task.h"
+#include "Mutex.h"
+
+namespace TTP
+{
+
+class ThreadPool;
+class FunctionSlots;
+
+// A set of tasks submitted to a shared ThreadPool that can be waited
+// for on its own, without draining the rest of the pool. A waiting
+// thread runs the group's tasks that no PoolThread has started yet.
+// The destructor waits for the group.
+class TaskGroup
+{
+public:
+    explicit TaskGroup(ThreadPool &pool);
+    ~TaskGroup();
+    // returns false if the pool refused the task
+    bool execute(Task *task);
+    bool execute(Task &task);
+    bool execute(Task *task, int priority);
+    // helps with the queued tasks of the group, then blocks until
+    // every task of the group has finished
+    void wait();
+    // withdraws the tasks no thread has started yet,
+    // returns the number of tasks withdrawn
+    size_t cancelPending();
+private:
+    // stands in for a task in the pool queue, whoever claims it first
+    // (a PoolThread or a waiter) runs the task. It may outlive the
+    // group in the queue, so it lives in a block of the pool's
+    // FunctionSlots rather than in the group.
+    class GroupTask : public Task
+    {
+    public:
+        // a proxy in a block of slots, on the heap if there is none
+        static GroupTask* create(TaskGroup *group, Task *task, FunctionSlots *slots);
+        void run();
+        bool claim();
+        bool cancel();
+        bool isQueued();
+        // dropped by the pool because its deadline passed
+        void expired();
+        // runs, or expires, the wrapped task on the calling thread and
+        // queues its continuations
+        void execute(bool expired = false);
+        void retain();
+        void release();
+    private:
+        GroupTask(TaskGroup *group, Task *task);
+    private:
+        enum { QUEUED = 0, CLAIMED = 1, CANCELLED = 2 };
+        // the block's owner, NULL for a heap allocated proxy
+        FunctionSlots *m_slots;
+        TaskGroup *m_group;
+        Task *m_task;
+        volatile int m_state;
+        // one reference for the group, one for the pool queue
+        volatile int m_refs;
+    };
+    void finished();
+    // callers must hold m_cond, releases the finished GroupTasks
+    void clear();
+private:
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator = (const TaskGroup&);
+private:
+    ThreadPool &m_pool;
+    Condition m_cond;
+    std::vector<GroupTask*> m_tasks;
+    // tasks queued or running
+    long m_pending;
+    int m_waiters;
+};
+
+} // namespace TTP
+#endif /* TASKGROUP_H_ */
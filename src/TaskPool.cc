@@ -6,7 +6,16 @@
  */
 
 #include <assert.h>
+#include <string.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#endif
 #include "TaskPool.h"
+#include "ThreadPool.h"
 
 namespace TTP
 {
@@ -15,61 +24,164 @@ void* TaskPool::run(void *arg)
 {
 	TaskPool* pool = static_cast<TaskPool*>(arg);
 	assert(pool != NULL);
-	std::vector<Task*>::iterator iter;
-	pool->m_mutex->lock();
-	bool fl = pool->m_runFlag;
-	pool->m_mutex->unlock();
-	while(fl) {
-		pool->m_mutex->lock();
-		int total = pool->m_scheduledtasks->size();
-		pool->m_mutex->unlock();
-		std::queue<int> tobeRemoved;
-		for (int i=0; i<total; ++i) {
+	std::vector<Task*> expired;
+	std::vector<TimerEntry*> fired;
+#if defined(__linux__)
+	if (pool->m_timerSpin > 0) {
+		// the futex waits of this thread must not be stretched either
+		prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+	}
+#endif
+	pool->m_timerCond->lock();
+	while (pool->m_runFlag) {
+		long long now = Timer::getCurrentTime();
+		TimerEntry *entry = pool->m_wheel->advance(now);
+		while (entry != NULL) {
+			TimerEntry *next = entry->m_next;
+			// stays allocated until its task is queued, a periodic one
+			// until rearm() puts it back after the run
+			entry->m_next = NULL;
+			expired.push_back(entry->m_period > 0 ? entry : entry->m_task);
+			fired.push_back(entry);
+			entry = next;
+		}
+		if (!expired.empty()) {
+			atomicStore(&pool->m_scheduled, static_cast<long>(pool->m_wheel->size()),
+					__ATOMIC_RELAXED);
+			pool->m_timerCond->unlock();
 			pool->m_mutex->lock();
-			Task* task = pool->m_scheduledtasks->at(i);
-			Timer* timer = pool->m_scheduledTimers->at(i);
+			size_t ready = 0;
+			for (; ready < expired.size(); ++ready) {
+				if (!pool->pushReady(expired[ready])) {
+					break;
+				}
+			}
 			pool->m_mutex->unlock();
-			if(task != NULL) {
-				if(task->isWaitOver(timer)) {
-					tobeRemoved.push(i);
-					pool->m_mutex->lock();
-					pool->m_tasks->push(task);
-					pool->m_mutex->unlock();
+			if (ready > 0) {
+				pool->m_owner->notify(static_cast<size_t>(ready));
+			}
+			pool->m_timerCond->lock();
+			for (size_t i = 0; i < ready; ++i) {
+				if (fired[i]->m_period == 0) {
+					pool->m_wheel->release(fired[i]);
 				}
 			}
+			// a full ring keeps the rest in the wheel for another
+			// millisecond, their handles stay valid, as after rearm()
+			for (size_t i = ready; i < fired.size(); ++i) {
+				if (fired[i]->m_cancelled) {
+					pool->m_wheel->release(fired[i]);
+					continue;
+				}
+				fired[i]->m_due = now + 1000000LL;
+				pool->m_wheel->insert(fired[i]);
+				pool->wakeTimer(fired[i]->m_due);
+			}
+			atomicStore(&pool->m_scheduled, static_cast<long>(pool->m_wheel->size()),
+					__ATOMIC_RELAXED);
+			expired.clear();
+			fired.clear();
+			continue;
 		}
-		int counter = 0;
-		while (!tobeRemoved.empty()) {
-			int index = tobeRemoved.front() - counter;
-			++counter;
-			tobeRemoved.pop();
-			pool->m_mutex->lock();
-			Timer* timer = pool->m_scheduledTimers->at(index);
-			pool->m_scheduledtasks->erase(pool->m_scheduledtasks->begin()+index);
-			pool->m_scheduledTimers->erase(pool->m_scheduledTimers->begin()+index);
-			delete timer;
-			pool->m_mutex->unlock();
+		pool->m_wakeAt = pool->m_wheel->nextDeadline();
+		if (pool->m_timerSpin > 0) {
+			if (pool->m_wakeAt < 0 || pool->m_wakeAt > now) {
+				pool->sleepPrecise();
+			}
+		}
+		else if (pool->m_wakeAt < 0) {
+			pool->m_timerCond->wait();
 		}
-		Thread::nSleep(1);
-		pool->m_mutex->lock();
-		fl = pool->m_runFlag;
-		pool->m_mutex->unlock();
-	}
-	pool->m_mutex->lock();
-	pool->m_complete = true;
-	pool->m_mutex->unlock();
+		else if (pool->m_wakeAt > now) {
+			pool->m_timerCond->waitUntil(pool->m_wakeAt);
+		}
+	}
+	pool->m_timerCond->unlock();
 	return NULL;
 }
 
-TaskPool::TaskPool()
+void TaskPool::sleepPrecise()
 {
-	m_mutex = new Mutex();
+#if defined(__linux__)
+	long long deadline = m_wakeAt;
+	m_timerCond->unlock();
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	long long armAt = deadline - m_timerSpin;
+	if (deadline >= 0 && armAt > Timer::getCurrentTime()) {
+		spec.it_value.tv_sec = static_cast<time_t>(armAt / 1000000000LL);
+		spec.it_value.tv_nsec = static_cast<long>(armAt % 1000000000LL);
+	}
+	if (deadline < 0 || spec.it_value.tv_sec != 0 || spec.it_value.tv_nsec != 0) {
+		// a zero value disarms the timerfd while the wheel is empty
+		timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+		struct pollfd fds[2];
+		fds[0].fd = m_timerFd;
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		fds[1].fd = m_wakeFd;
+		fds[1].events = POLLIN;
+		fds[1].revents = 0;
+		poll(fds, 2, -1);
+		unsigned long long count;
+		if (fds[0].revents & POLLIN) {
+			(void) !read(m_timerFd, &count, sizeof(count));
+		}
+		if (fds[1].revents & POLLIN) {
+			(void) !read(m_wakeFd, &count, sizeof(count));
+			m_timerCond->lock();
+			return;
+		}
+	}
+	// the last stretch is spun on the vDSO clock, which reads the TSC
+	while (Timer::getCurrentTime() < deadline) {
+		cpuRelax();
+	}
+	m_timerCond->lock();
+#endif
+}
+
+TaskPool::TaskPool(int engine, long capacity, long timerSpin, int lowp, int highp,
+		int priorityEngine, long heaps)
+{
+	m_mutex = new Condition();
+	m_owner = NULL;
 	m_tasks = new std::queue<Task*>;
-	m_ptasks = new std::list<Task*>;
-	m_scheduledtasks = new std::vector<Task*>;
-	m_scheduledTimers = new std::vector<Timer*>;
+	m_ring = NULL;
+	if (engine == PoolOptions::QUEUE_RING) {
+		m_ring = new BoundedQueue(capacity);
+	}
+	m_ptasks = new PriorityQueue(lowp, highp);
+	m_deadlines = NULL;
+	m_relaxed = NULL;
+	if (priorityEngine == PoolOptions::PRIORITY_DEADLINE) {
+		m_deadlines = new DeadlineQueue;
+	}
+	else if (priorityEngine == PoolOptions::PRIORITY_MULTIQUEUE) {
+		m_relaxed = new MultiQueue(heaps);
+	}
+	m_wheel = new TimingWheel(Timer::getCurrentTime());
+	m_timerCond = new Condition();
+	m_wakeAt = -1;
+	m_scheduled = 0;
+	m_timerSpin = 0;
+	m_timerFd = -1;
+	m_wakeFd = -1;
+#if defined(__linux__)
+	if (timerSpin > 0) {
+		m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (m_timerFd >= 0 && m_wakeFd >= 0) {
+			m_timerSpin = timerSpin;
+		}
+	}
+#else
+	(void) timerSpin;
+#endif
+	m_queued = 0;
+	m_lastTake = Timer::getCurrentTime();
 	m_runFlag = true;
-	m_complete = false;
+	m_prioritized = false;
 	m_thread = new Thread(&run, this);
 	m_thrdStarted = false;
 }
@@ -83,116 +195,397 @@ void TaskPool::start()
 	m_thrdStarted = true;
 }
 
-void TaskPool::addTask(Task &task)
+bool TaskPool::addTask(Task &task)
 {
-	m_mutex->lock();
-	if (task.m_type >= 0 && task.m_type <= 6 && task.m_tunit > 0) {
-		Timer* t = new Timer;
-		t->start();
-		m_scheduledTimers->push_back(t);
-		m_scheduledtasks->push_back(&task);
-	}
-	else {
-	    m_tasks->push(&task);
-	}
-	m_mutex->unlock();
+	return addTask(&task);
 }
 
-void TaskPool::addTask(Task *task)
+bool TaskPool::addTask(Task *task)
 {
-	m_mutex->lock();
+	bool added = true;
 	if (task->m_type >= 0 && task->m_type <= 6 && task->m_tunit > 0) {
-		Timer* t = new Timer;
-		t->start();
-		m_scheduledTimers->push_back(t);
-		m_scheduledtasks->push_back(task);
+		long long deadline = Timer::getCurrentTime()
+				+ TimeUnit::toNanoSeconds(task->m_tunit, task->m_type);
+		m_timerCond->lock();
+		pushScheduled(task, deadline);
+		m_timerCond->unlock();
+	}
+	else if (m_ring != NULL) {
+		added = m_ring->push(task);
+		if (added) {
+			countPush();
+		}
 	}
 	else {
-	    m_tasks->push(task);
+		m_mutex->lock();
+		m_tasks->push(task);
+		countPush();
+		m_mutex->unlock();
 	}
-	m_mutex->unlock();
+	return added;
 }
 
 void TaskPool::addPTask(Task &task)
 {
-	m_mutex->lock();
-	m_ptasks->push_back(&task);
-	m_mutex->unlock();
+	addPTask(&task);
 }
 
 void TaskPool::addPTask(Task *task)
 {
+	if (m_relaxed != NULL) {
+		pushPTask(task);
+		return;
+	}
 	m_mutex->lock();
-	m_ptasks->push_back(task);
+	pushPTask(task);
 	m_mutex->unlock();
 }
 
+long TaskPool::addTasks(Task **tasks, long count)
+{
+	assert(m_ring != NULL);
+	long added = m_ring->push(tasks, count);
+	if (added > 0) {
+		countPush(added);
+	}
+	return added;
+}
+
 Task* TaskPool::getTask()
 {
-	Task *task = NULL;
-	m_mutex->lock();
-	if(!m_tasks->empty()) {
-		task = m_tasks->front();
-		m_tasks->pop();
+	if (m_ring != NULL) {
+		return popTask();
 	}
+	m_mutex->lock();
+	Task *task = popTask();
 	m_mutex->unlock();
 	return task;
 }
+
 Task* TaskPool::getPTask()
 {
 	m_mutex->lock();
-	int currpri = 0;
-	Task *task = NULL;
-	std::list<Task*>::iterator iter, iter1;
-	for (iter = m_ptasks->begin(); iter != m_ptasks->end(); ++iter) {
-		if ((*iter)->m_priority > currpri) {
-			task = *iter;
-			iter1 = iter;
-			currpri = task->m_priority;
+	Task *task = popPTask();
+	m_mutex->unlock();
+	return task;
+}
+
+void TaskPool::countPush(long count)
+{
+	// tasks arriving at an empty queue start a new queue age
+	if (atomicAdd(&m_queued, count) == count) {
+		atomicStore(&m_lastTake, Timer::getCurrentTime(), __ATOMIC_RELAXED);
+	}
+}
+
+void TaskPool::setNodes(int nodes, long capacity)
+{
+	for (int i = static_cast<int>(m_nodeTasks.size()); i < nodes; ++i) {
+		m_nodeTasks.push_back(new BoundedQueue(capacity));
+	}
+}
+
+int TaskPool::nodes() const
+{
+	return m_nodeTasks.empty() ? 1 : static_cast<int>(m_nodeTasks.size());
+}
+
+bool TaskPool::addNodeTask(Task *task, int node)
+{
+	if (!m_nodeTasks[node]->push(task)) {
+		return false;
+	}
+	countPush();
+	return true;
+}
+
+Task* TaskPool::getNodeTask(int node)
+{
+	Task *task = m_nodeTasks[node]->pop();
+	if (task != NULL) {
+		atomicSub(&m_queued, 1L);
+		atomicStore(&m_lastTake, Timer::getCurrentTime(), __ATOMIC_RELAXED);
+	}
+	return task;
+}
+
+Task* TaskPool::getRemoteTask(int node)
+{
+	size_t count = m_nodeTasks.size();
+	for (size_t i = 1; i < count; ++i) {
+		Task *task = getNodeTask(static_cast<int>((node + i) % count));
+		if (task != NULL) {
+			return task;
+		}
+	}
+	return NULL;
+}
+
+bool TaskPool::pushReady(Task *task)
+{
+	if (m_prioritized) {
+		pushPTask(task);
+		return true;
+	}
+	if (m_ring != NULL) {
+		if (!m_ring->push(task)) {
+			return false;
+		}
+	}
+	else {
+		m_tasks->push(task);
+	}
+	countPush();
+	return true;
+}
+
+void TaskPool::pushPTask(Task *task)
+{
+	if (m_deadlines != NULL) {
+		m_deadlines->push(task);
+	}
+	else if (m_relaxed != NULL) {
+		m_relaxed->push(task);
+	}
+	else {
+		m_ptasks->push(task);
+	}
+	countPush();
+}
+
+TimerEntry* TaskPool::pushScheduled(Task *task, long long deadline)
+{
+	TimerEntry *entry = m_wheel->allocate();
+	entry->m_task = task;
+	entry->m_due = deadline;
+	m_wheel->insert(entry);
+	atomicStore(&m_scheduled, static_cast<long>(m_wheel->size()), __ATOMIC_RELAXED);
+	wakeTimer(deadline);
+	return entry;
+}
+
+void TaskPool::wakeTimer(long long deadline)
+{
+	// the timer thread only needs to hear of an earlier deadline
+	if (m_wakeAt < 0 || deadline < m_wakeAt) {
+		m_wakeAt = deadline;
+		m_timerCond->signal();
+#if defined(__linux__)
+		if (m_timerSpin > 0) {
+			unsigned long long one = 1;
+			(void) !write(m_wakeFd, &one, sizeof(one));
+		}
+#endif
+	}
+}
+
+TimerEntry* TaskPool::addScheduled(Task *task, long long deadline, unsigned int &generation)
+{
+	m_timerCond->lock();
+	TimerEntry *entry = pushScheduled(task, deadline);
+	generation = entry->m_generation;
+	m_timerCond->unlock();
+	return entry;
+}
+
+void TaskPool::addPeriodic(TimerEntry *entry, unsigned int &generation)
+{
+	m_timerCond->lock();
+	m_wheel->insert(entry);
+	atomicStore(&m_scheduled, static_cast<long>(m_wheel->size()), __ATOMIC_RELAXED);
+	wakeTimer(entry->m_due);
+	generation = entry->m_generation;
+	m_timerCond->unlock();
+}
+
+bool TaskPool::cancelScheduled(TimerEntry *entry, unsigned int generation, bool &removed)
+{
+	bool cancelled = false;
+	removed = false;
+	m_timerCond->lock();
+	if (entry->m_generation == generation) {
+		if (entry->m_slot >= 0) {
+			m_wheel->remove(entry);
+			m_wheel->release(entry);
+			atomicStore(&m_scheduled, static_cast<long>(m_wheel->size()), __ATOMIC_RELAXED);
+			removed = true;
+			cancelled = true;
+		}
+		else if (entry->m_period > 0 && !entry->m_cancelled) {
+			// queued or running, rearm() releases it
+			atomicStore(&entry->m_cancelled, true);
+			cancelled = true;
+		}
+	}
+	m_timerCond->unlock();
+	return cancelled;
+}
+
+void TaskPool::rearm(TimerEntry *entry)
+{
+	long long now = Timer::getCurrentTime();
+	m_timerCond->lock();
+	if (entry->m_cancelled) {
+		m_wheel->release(entry);
+		m_timerCond->unlock();
+		return;
+	}
+	if (!entry->m_fixedRate) {
+		entry->m_due = now + entry->m_period;
+	}
+	else if (entry->m_due + entry->m_period > now) {
+		entry->m_due += entry->m_period;
+	}
+	else {
+		// overrun, the missed periods are coalesced into one run right
+		// away on the last grid point, the grid itself does not drift
+		entry->m_due += (now - entry->m_due) / entry->m_period * entry->m_period;
+	}
+	m_wheel->insert(entry);
+	atomicStore(&m_scheduled, static_cast<long>(m_wheel->size()), __ATOMIC_RELAXED);
+	wakeTimer(entry->m_due);
+	m_timerCond->unlock();
+}
+
+bool TaskPool::reschedule(TimerEntry *entry, unsigned int generation, long long deadline)
+{
+	bool pending = false;
+	m_timerCond->lock();
+	if (entry->m_generation == generation && entry->m_slot >= 0) {
+		// a fixed rate entry keeps to the grid of its new deadline
+		m_wheel->remove(entry);
+		entry->m_due = deadline;
+		m_wheel->insert(entry);
+		wakeTimer(deadline);
+		pending = true;
+	}
+	m_timerCond->unlock();
+	return pending;
+}
+
+bool TaskPool::isScheduled(TimerEntry *entry, unsigned int generation)
+{
+	m_timerCond->lock();
+	bool pending = entry->m_generation == generation
+			&& (entry->m_slot >= 0 || (entry->m_period > 0 && !entry->m_cancelled));
+	m_timerCond->unlock();
+	return pending;
+}
+
+bool TaskPool::hasTasks()
+{
+	for (size_t i = 0; i < m_nodeTasks.size(); ++i) {
+		if (!m_nodeTasks[i]->empty()) {
+			return true;
 		}
 	}
+	if (m_ring != NULL) {
+		return !m_ring->empty();
+	}
+	return !m_tasks->empty();
+}
+
+Task* TaskPool::popTask()
+{
+	Task *task = NULL;
+	if (m_ring != NULL) {
+		task = m_ring->pop();
+	}
+	else if(!m_tasks->empty()) {
+		task = m_tasks->front();
+		m_tasks->pop();
+	}
+	if (task != NULL) {
+		atomicSub(&m_queued, 1L);
+		atomicStore(&m_lastTake, Timer::getCurrentTime(), __ATOMIC_RELAXED);
+	}
+	return task;
+}
+
+Task* TaskPool::popPTask(bool reserved)
+{
+	Task *task = NULL;
+	if (m_deadlines != NULL) {
+		task = m_deadlines->pop();
+	}
+	else if (m_relaxed != NULL) {
+		task = m_relaxed->pop();
+	}
+	else {
+		task = m_ptasks->pop(reserved);
+	}
 	if(task != NULL) {
-	    m_ptasks->remove(task);
+	    atomicSub(&m_queued, 1L);
+	    atomicStore(&m_lastTake, Timer::getCurrentTime(), __ATOMIC_RELAXED);
 	}
-	m_mutex->unlock();
 	return task;
 }
+
+bool TaskPool::hasPTasks(bool reserved)
+{
+	if (m_deadlines != NULL) {
+		return !m_deadlines->empty();
+	}
+	if (m_relaxed != NULL) {
+		return !m_relaxed->empty();
+	}
+	return m_ptasks->ready(reserved);
+}
+
 bool TaskPool::tasksPending()
 {
 	m_mutex->lock();
-	bool tp = !m_tasks->empty();
-	tp |= !m_scheduledtasks->empty();
+	bool tp = hasTasks();
+	tp |= atomicLoad(&m_scheduled, __ATOMIC_RELAXED) > 0;
 	m_mutex->unlock();
 	return tp;
 }
 bool TaskPool::tasksPPending()
 {
 	m_mutex->lock();
-	bool tp = !m_ptasks->empty();
-	tp |= !m_scheduledtasks->empty();
+	bool tp = hasPTasks(false);
+	tp |= atomicLoad(&m_scheduled, __ATOMIC_RELAXED) > 0;
 	m_mutex->unlock();
 	return tp;
 }
+long TaskPool::queued()
+{
+	return atomicLoad(&m_queued, __ATOMIC_RELAXED);
+}
+
+long long TaskPool::lastTake()
+{
+	return atomicLoad(&m_lastTake, __ATOMIC_RELAXED);
+}
+
 TaskPool::~TaskPool()
 {
-	m_mutex->lock();
+	m_timerCond->lock();
 	m_runFlag = false;
-	m_mutex->unlock();
-	m_mutex->lock();
-	bool fl = m_complete;
-	m_mutex->unlock();
-	while(!fl) {
-		m_mutex->lock();
-		fl = m_complete;
-		m_mutex->unlock();
-		Thread::mSleep(1);
+	m_wakeAt = -1;
+	wakeTimer(0);
+	m_timerCond->unlock();
+	m_thread->join();
+#if defined(__linux__)
+	if (m_timerFd >= 0) {
+		close(m_timerFd);
 	}
+	if (m_wakeFd >= 0) {
+		close(m_wakeFd);
+	}
+#endif
 	delete m_thread;
 	delete m_tasks;
+	delete m_ring;
 	delete m_ptasks;
-	delete m_scheduledtasks;
-	delete m_scheduledTimers;
+	delete m_deadlines;
+	delete m_relaxed;
+	delete m_wheel;
+	delete m_timerCond;
 	delete m_mutex;
+	for (size_t i = 0; i < m_nodeTasks.size(); ++i) {
+		delete m_nodeTasks[i];
+	}
 }
 
 } // namespace TTP
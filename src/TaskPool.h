@@ -9,40 +9,132 @@
 #define TASKPOOL_H_
 #include <vector>
 #include <queue>
-#include <list>
 #include "Task.h"
 #include "Mutex.h"
 #include "Thread.h"
 #include "TimeUnit.h"
 #include "Timer.h"
+#include "Atomic.h"
+#include "BoundedQueue.h"
+#include "PoolOptions.h"
+#include "TimingWheel.h"
+#include "PriorityQueue.h"
+#include "DeadlineQueue.h"
+#include "MultiQueue.h"
 
 namespace TTP
 {
 
+class ThreadPool;
+
 class TaskPool
 {
     friend class ThreadPool;
 public:
-	TaskPool();
+	// engine is one of the PoolOptions::QUEUE_* values, capacity
+	// bounds the QUEUE_RING engine, [lowp, highp] is the range of
+	// the priority queue, priorityEngine one of the PRIORITY_* values
+	// and heaps the size of the PRIORITY_MULTIQUEUE engine
+	TaskPool(int engine = PoolOptions::QUEUE_LOCKED, long capacity = 0,
+			long timerSpin = 0, int lowp = 0, int highp = 0,
+			int priorityEngine = PoolOptions::PRIORITY_BUCKETS, long heaps = 0);
 	~TaskPool();
 	void start();
-	void addTask(Task &task);
-	void addTask(Task *task);
+	// returns false if a bounded queue is full; no add wakes a
+	// thread, the ThreadPool does after the push
+	bool addTask(Task &task);
+	bool addTask(Task *task);
+	// the PRIORITY_MULTIQUEUE engine takes no lock
 	void addPTask(Task &task);
 	void addPTask(Task *task);
+	// pushes up to count ready tasks into the QUEUE_RING engine,
+	// returns the number of tasks queued
+	long addTasks(Task **tasks, long count);
+	// queues a task due at deadline, generation receives the
+	// entry's generation for a ScheduleHandle
+	TimerEntry* addScheduled(Task *task, long long deadline, unsigned int &generation);
+	// queues a periodic entry armed by the caller
+	void addPeriodic(TimerEntry *entry, unsigned int &generation);
+	// false if the task will run anyway; removed is set if the entry
+	// left the wheel, a running periodic entry is only marked
+	bool cancelScheduled(TimerEntry *entry, unsigned int generation, bool &removed);
+	// puts a periodic entry back into the wheel after a run,
+	// or releases it once cancelled
+	void rearm(TimerEntry *entry);
+	bool reschedule(TimerEntry *entry, unsigned int generation, long long deadline);
+	bool isScheduled(TimerEntry *entry, unsigned int generation);
 	Task* getTask();
 	Task* getPTask();
 	bool tasksPending();
 	bool tasksPPending();
+	// approximate number of queued tasks, read without the lock
+	long queued();
+	// Timer::getCurrentTime() of the last task taken off the queues
+	long long lastTake();
 	static void* run(void *arg);
+private:
+	// callers must hold m_mutex, popTask() needs no lock with the
+	// QUEUE_RING engine and popPTask() none with PRIORITY_MULTIQUEUE
+	Task* popTask();
+	// a reserved PoolThread only gets what PriorityQueue::pop() hands
+	// to reserved threads
+	Task* popPTask(bool reserved = false);
+	bool hasPTasks(bool reserved);
+	// moves a task whose delay is over to the ready queue
+	bool pushReady(Task *task);
+	void pushPTask(Task *task);
+	// callers must hold m_timerCond
+	TimerEntry* pushScheduled(Task *task, long long deadline);
+	void wakeTimer(long long deadline);
+	// precision timer: sleeps on the timerfd until m_wakeAt minus the
+	// spin, then spins; called and returns with m_timerCond held
+	void sleepPrecise();
+	bool hasTasks();
+	// splits the ready queue by NUMA node, each node gets a ring of
+	// capacity tasks; called before any PoolThread runs
+	void setNodes(int nodes, long capacity);
+	int nodes() const;
+	// the per node rings, none needs a lock; addNodeTask() returns
+	// false if the ring is full and wakes no thread
+	bool addNodeTask(Task *task, int node);
+	Task* getNodeTask(int node);
+	// the rings of the other nodes, in turn from the one after node
+	Task* getRemoteTask(int node);
+	void countPush(long count = 1);
 private:
     std::queue<Task*> *m_tasks;
-    std::list<Task*> *m_ptasks;
-    std::vector<Task*> *m_scheduledtasks;
-    std::vector<Timer*> *m_scheduledTimers;
-    Mutex *m_mutex;
+    // lock-free replacement of m_tasks for the QUEUE_RING engine
+    BoundedQueue *m_ring;
+    PriorityQueue *m_ptasks;
+    // PRIORITY_DEADLINE engine, takes the place of m_ptasks if set
+    DeadlineQueue *m_deadlines;
+    // PRIORITY_MULTIQUEUE engine, takes the place of m_ptasks if set
+    MultiQueue *m_relaxed;
+    // delayed tasks, the timer thread sleeps on m_timerCond until
+    // the next deadline or an earlier task arrives
+    TimingWheel *m_wheel;
+    Condition *m_timerCond;
+    // deadline the timer thread sleeps until, -1 for none
+    long long m_wakeAt;
+    // entries in m_wheel, read without m_timerCond
+    volatile long m_scheduled;
+    // precision timer, see PoolOptions::m_timerSpin
+    long m_timerSpin;
+    int m_timerFd;
+    // written to wake the precision timer for an earlier deadline
+    int m_wakeFd;
+    // guards the queues
+    Condition *m_mutex;
+    // a ring per node after setNodes(), empty before
+    std::vector<BoundedQueue*> m_nodeTasks;
+    // wakes PoolThreads for the tasks the timer thread made ready
+    ThreadPool *m_owner;
     Thread *m_thread;
-    volatile bool m_runFlag, m_complete, m_thrdStarted;
+    volatile long m_queued;
+    volatile long long m_lastTake;
+    volatile bool m_runFlag, m_thrdStarted;
+    // expired tasks go to m_ptasks
+    bool m_prioritized;
 };
 
 } // namespace TTP
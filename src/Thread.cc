@@ -51,7 +51,7 @@ int Thread::yield()
 }
 
 Thread::Thread()
-:m_id(-1),m_name("Thread"),m_running(false)
+:m_id(-1),m_name("Thread"),m_running(false),m_joinable(false)
 {
     m_threadFunctor = new ThreadFunctor();
     m_threadFunctor->thread = this;
@@ -63,7 +63,7 @@ Thread::Thread()
 }
 
 Thread::Thread(ThreadFunc f, void* arg)
-:m_id(-1),m_name("Thread"),m_running(false)
+:m_id(-1),m_name("Thread"),m_running(false),m_joinable(false)
 {
     m_threadFunctor = new ThreadFunctor();
     m_threadFunctor->thread = this;
@@ -86,7 +86,9 @@ Thread::~Thread()
 
 void Thread::join()
 {
-    if (m_running) {
+    // the thread may already have left its function and reset m_running,
+    // it still has to be joined to release its resources
+    if (m_joinable) {
         int status;
 
         // wait for thread to finish
@@ -97,6 +99,7 @@ void Thread::join()
         }
 
         m_running = false;
+        m_joinable = false;
     }// if
 }
 
@@ -141,6 +144,8 @@ void Thread::execute(const bool detached,const bool sscope)
     if (!m_running)
     {
         int status;
+        // reap a previous run of this thread before starting it again
+        join();
         pthread_attr_t  thread_attr;
 
         if ((status = pthread_attr_init(&thread_attr)) != 0) {
@@ -168,6 +173,24 @@ void Thread::execute(const bool detached,const bool sscope)
             }// if
         }// if
 
+#if defined(__linux__)
+        if (!m_affinity.empty()) {
+            // set before the thread exists, its stack is first
+            // touched on these CPUs
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            for (size_t i = 0; i < m_affinity.size(); ++i) {
+                if (m_affinity[i] >= 0 && m_affinity[i] < CPU_SETSIZE) {
+                    CPU_SET(m_affinity[i], &cpus);
+                }
+            }
+            if ((status = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpus), &cpus)) != 0) {
+                std::cerr << "Thread create : pthread_attr_setaffinity_np ("
+                        << strerror( status ) << ")" << std::endl;
+            }
+        }
+#endif
+
 #if defined(_POSIX_THREAD_PRIORITY_SCHEDULING) && defined(SUNOS)
         //
         // adjust thread-scheduling for Solaris
@@ -205,6 +228,7 @@ void Thread::execute(const bool detached,const bool sscope)
         }
         else {
             m_running = true;
+            m_joinable = !detached;
         }
 
         // remove attribute
@@ -260,6 +284,11 @@ void Thread::resetRunning()
     m_running = false;
 }
 
+void Thread::setAffinity(const std::vector<int> &cpus)
+{
+    m_affinity = cpus;
+}
+
 void Thread::detach ()
 {
     if (m_running) {
@@ -269,6 +298,7 @@ void Thread::detach ()
             std::cerr << "Thread detach : pthread_detach ("
                     << strerror(status) << ")" << std::endl;
         }
+        m_joinable = false;
     }// if
 }
 
@@ -281,6 +311,7 @@ void Thread::cancel()
                     << strerror(status) << ")" << std::endl;
         }
         m_running = false;
+        m_joinable = false;
     }// if
 }
 
@@ -11,6 +11,7 @@
 #include <time.h>
 #include <unistd.h>
 #include <string>
+#include <vector>
 
 namespace TTP
 {
@@ -73,6 +74,9 @@ public:
     void setName(const std::string &name);
     // get thread name
     std::string getName() const;
+    // CPUs the thread may run on once execute() starts it, empty
+    // for all; Linux only
+    void setAffinity(const std::vector<int> &cpus);
     // detach thread
     void detach();
     // request cancellation of thread
@@ -101,6 +105,9 @@ private:
     std::string m_name;
     // is the thread running or not
     volatile bool m_running;
+    // pthread was created joinable and has not been joined yet
+    bool m_joinable;
+    std::vector<int> m_affinity;
     ThreadFunctor* m_threadFunctor;
     pthread_t m_pthread;
     pthread_cond_t m_cond;
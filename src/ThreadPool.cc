@@ -6,7 +6,16 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <new>
+#include <algorithm>
+#include <iostream>
+#include <exception>
+#include "Atomic.h"
 #include "ThreadPool.h"
+#include "Topology.h"
 
 namespace TTP
 {
@@ -14,21 +23,22 @@ namespace TTP
 ThreadPool::ThreadPool()
 {
     m_runFlag = false;
-    m_joinComplete = false;
     m_wpool = NULL;
-    m_maxThreads = 0;
-    m_initThreads = 0;
-    m_lowp = -1;
-    m_highp = -1;
-    m_tpool = NULL;
-    m_wpool = NULL;
-    m_poller = NULL;
-    m_prioritypooling = false;
-    m_runFlag = false;
-    m_complete = false;
-    m_pollerStarted = false;
-    m_mutex = NULL;
-    m_joinComplete = false;
+    m_workers = NULL;
+    m_idleStacks = NULL;
+    m_idleStackCount = 0;
+    m_started = false;
+    m_sleepers = 0;
+    m_reservedSleepers = 0;
+    m_threadCount = 0;
+    m_liveThreads = 0;
+    m_outstanding = 0;
+    m_idleCond = NULL;
+    m_functions = NULL;
+    PoolOptions options;
+    options.m_initThreads = 0;
+    options.m_maxThreads = 0;
+    configure(options);
 }
 
 void ThreadPool::init(int initThreads, int maxThreads)
@@ -37,256 +47,1088 @@ void ThreadPool::init(int initThreads, int maxThreads)
 	    return;
 	}
 
-	m_lowp = -1;
-	m_highp = -1;
-	m_initThreads = initThreads;
-	m_maxThreads = maxThreads;
-	m_joinComplete = false;
-	m_prioritypooling = false;
+	PoolOptions options;
+	options.m_initThreads = initThreads;
+	options.m_maxThreads = maxThreads;
+	configure(options);
 	initializeThreads();
 	start();
 }
 
 ThreadPool::ThreadPool(int initThreads, int maxThreads, int lowp, int highp)
 {
-	if (lowp > highp) {
-		throw "Low Priority should be less than Highest Priority";
-	}
-	m_initThreads = initThreads;
-	m_maxThreads = maxThreads;
-	m_lowp = lowp;
-	m_highp = highp;
+	PoolOptions options;
+	options.m_initThreads = initThreads;
+	options.m_maxThreads = maxThreads;
+	options.m_lowp = lowp;
+	options.m_highp = highp;
+	options.m_prioritypooling = true;
+	checkPriorities(options);
+	configure(options);
 	m_runFlag = false;
-	m_joinComplete = false;
-	m_prioritypooling = true;
 	initializeThreads();
 }
 
 ThreadPool::ThreadPool(int initThreads, int maxThreads)
 {
-    m_lowp = -1;
-    m_highp = -1;
-    m_initThreads = initThreads;
-    m_maxThreads = maxThreads;
-    m_runFlag = false;
-    m_joinComplete = false;
-    m_prioritypooling = false;
+	PoolOptions options;
+	options.m_initThreads = initThreads;
+	options.m_maxThreads = maxThreads;
+	configure(options);
+	m_runFlag = false;
 	initializeThreads();
 }
 
+ThreadPool::ThreadPool(const PoolOptions &options)
+{
+	checkPriorities(options);
+	configure(options);
+	m_runFlag = false;
+	initializeThreads();
+}
+
+void ThreadPool::checkPriorities(const PoolOptions &options)
+{
+	if (!options.m_prioritypooling) {
+		return;
+	}
+	if (options.m_lowp > options.m_highp) {
+		throw "Low Priority should be less than Highest Priority";
+	}
+	if (static_cast<long>(options.m_highp) - options.m_lowp >= PriorityQueue::MAX_LEVELS) {
+		throw "Priority range exceeds PriorityQueue::MAX_LEVELS";
+	}
+}
+
+void ThreadPool::configure(const PoolOptions &options)
+{
+	m_initThreads = options.m_initThreads;
+	m_maxThreads = options.m_maxThreads;
+	if (m_maxThreads < m_initThreads) {
+		m_maxThreads = m_initThreads;
+	}
+	m_lowp = options.m_prioritypooling ? options.m_lowp : -1;
+	m_highp = options.m_prioritypooling ? options.m_highp : -1;
+	m_prioritypooling = options.m_prioritypooling;
+	m_keepAlive = options.m_keepAlive;
+	m_growBacklog = options.m_growBacklog;
+	m_growAge = options.m_growAge;
+	m_queueEngine = options.m_queueEngine;
+	m_queueCapacity = options.m_queueCapacity;
+	m_functionSlots = options.m_functionSlots;
+	m_timerSpin = options.m_timerSpin;
+	m_spinNanos = options.m_spinMicros > 0 ? options.m_spinMicros * 1000LL : 0;
+	if (sysconf(_SC_NPROCESSORS_ONLN) <= 1) {
+		// the producer needs the only CPU the spinner would burn
+		m_spinNanos = 0;
+	}
+	m_weights = options.m_weights;
+	m_priorityEngine = options.m_priorityEngine;
+	m_dropExpired = options.m_dropExpired;
+	m_multiQueueFactor = options.m_multiQueueFactor;
+	// at least one thread for the tasks below m_reservedPriority
+	m_reservedThreads = 0;
+	if (m_prioritypooling && m_priorityEngine == PoolOptions::PRIORITY_BUCKETS
+			&& options.m_reservedThreads > 0) {
+		m_reservedThreads = options.m_reservedThreads < m_initThreads
+				? options.m_reservedThreads : m_initThreads - 1;
+	}
+	m_reservedPriority = options.m_reservedPriority;
+	m_nodeCpus.clear();
+	m_cpuNode.clear();
+	if (options.m_numaAware || !options.m_cpus.empty()) {
+		Topology topology;
+		for (int node = 0; node < topology.nodes(); ++node) {
+			std::vector<int> cpus;
+			for (size_t i = 0; i < topology.cpus(node).size(); ++i) {
+				int cpu = topology.cpus(node)[i];
+				if (options.m_cpus.empty() || std::find(options.m_cpus.begin(),
+						options.m_cpus.end(), cpu) != options.m_cpus.end()) {
+					cpus.push_back(cpu);
+				}
+			}
+			if (cpus.empty()) {
+				continue;
+			}
+			if (options.m_numaAware || m_nodeCpus.empty()) {
+				m_nodeCpus.push_back(cpus);
+			}
+			else {
+				m_nodeCpus.back().insert(m_nodeCpus.back().end(), cpus.begin(), cpus.end());
+			}
+		}
+	}
+	for (size_t node = 0; node < m_nodeCpus.size(); ++node) {
+		for (size_t i = 0; i < m_nodeCpus[node].size(); ++i) {
+			size_t cpu = static_cast<size_t>(m_nodeCpus[node][i]);
+			if (cpu >= m_cpuNode.size()) {
+				m_cpuNode.resize(cpu + 1, -1);
+			}
+			m_cpuNode[cpu] = static_cast<int>(node);
+		}
+	}
+}
+
 void ThreadPool::initializeThreads()
 {
     if(m_runFlag) {
         return;
     }
-	m_wpool = new TaskPool;
-	m_tpool = new std::vector<PoolThread*>;
+	m_wpool = new TaskPool(m_prioritypooling ? PoolOptions::QUEUE_LOCKED : m_queueEngine,
+			m_queueCapacity, m_timerSpin, m_lowp, m_highp,
+			// the engines only order priority pools
+			m_prioritypooling ? m_priorityEngine : PoolOptions::PRIORITY_BUCKETS,
+			static_cast<long>(m_multiQueueFactor) * m_maxThreads);
+	if (!m_prioritypooling && m_nodeCpus.size() > 1) {
+		m_wpool->setNodes(static_cast<int>(m_nodeCpus.size()), m_queueCapacity);
+	}
+	m_wpool->m_owner = this;
+	void *slots = NULL;
+	if (posix_memalign(&slots, PoolThread::CACHELINE,
+			sizeof(PoolThread) * (m_maxThreads > 0 ? m_maxThreads : 1)) != 0) {
+		throw std::bad_alloc();
+	}
+	m_workers = static_cast<PoolThread*>(slots);
+	m_idleStackCount = m_nodeCpus.empty() ? 1 : static_cast<int>(m_nodeCpus.size());
+	m_idleStacks = new IdleStack[m_idleStackCount + 1];
+	for (int i = 0; i <= m_idleStackCount; ++i) {
+		m_idleStacks[i].m_top = 0;
+	}
+	m_threadCount = 0;
 	for (int i = 0; i < m_initThreads; ++i) {
-		PoolThread *thread = new PoolThread();
-		thread->execute();
-		m_tpool->push_back(thread);
+		// the first threads are reserved, growth adds regular ones
+		createThread()->m_reserved = i < m_reservedThreads;
+	}
+	m_liveThreads = m_initThreads;
+	m_outstanding = 0;
+	m_idleCond = new Condition;
+	m_functions = new FunctionSlots(m_functionSlots > 0 ? m_functionSlots : 0);
+	m_wpool->m_prioritized = m_prioritypooling;
+	m_wpool->m_ptasks->setWeights(m_weights);
+	if (m_reservedThreads > 0) {
+		m_wpool->m_ptasks->setReserved(m_reservedPriority);
 	}
 	m_runFlag = true;
-	m_poller = new Thread(&ThreadPool::poll, this);
 	m_wpool->start();
-	m_pollerStarted = false;
-	m_complete = false;
-	m_mutex = new Mutex;
+	m_started = false;
+	m_sleepers = 0;
+	m_reservedSleepers = 0;
+	m_deadlineMisses = 0;
+	m_deadlineDrops = 0;
+}
+
+PoolThread* ThreadPool::createThread()
+{
+	int slot = m_threadCount;
+	PoolThread *thread = new (&m_workers[slot]) PoolThread(this);
+	if (!m_nodeCpus.empty()) {
+		// round robin, the nodes keep even shares as the pool grows
+		thread->m_node = slot % static_cast<int>(m_nodeCpus.size());
+		thread->m_thread->setAffinity(m_nodeCpus[thread->m_node]);
+	}
+	atomicStore(&m_threadCount, slot + 1, __ATOMIC_RELEASE);
+	return thread;
+}
+
+int ThreadPool::currentNode() const
+{
+#if defined(__linux__)
+	int cpu = sched_getcpu();
+	if (cpu >= 0 && static_cast<size_t>(cpu) < m_cpuNode.size()) {
+		return m_cpuNode[cpu];
+	}
+#endif
+	return -1;
+}
+
+int ThreadPool::numaNodes() const
+{
+	return m_nodeCpus.size() > 1 ? static_cast<int>(m_nodeCpus.size()) : 1;
 }
 
 void ThreadPool::start()
 {
-	if(m_pollerStarted) {
+	if(m_started) {
 	    return;
 	}
-	m_poller->execute();
-	m_pollerStarted = true;
+	m_wpool->m_mutex->lock();
+	for (int var = 0; var < m_threadCount; ++var) {
+		m_workers[var].execute();
+	}
+	m_started = true;
+	m_wpool->m_mutex->unlock();
 }
 
-void* ThreadPool::poll(void *arg)
+Task* ThreadPool::take(PoolThread *thread)
 {
-	ThreadPool* ths = static_cast<ThreadPool*>(arg);
-	assert(ths != NULL);
-	ths->m_mutex->lock();
-	bool fl = ths->m_runFlag;
-	ths->m_mutex->unlock();
-	while (fl) {
-		if (!ths->m_prioritypooling && ths->m_wpool->tasksPending()) {
-			Task *task = ths->m_wpool->getTask();
+	Task *task = NULL;
+	while (true) {
+		if (!m_prioritypooling) {
+			task = findTask(thread);
 			if (task != NULL) {
-				ths->submit(task);
+				thread->checkout(task);
+				break;
 			}
+			m_wpool->m_mutex->lock();
 		}
-		else if (ths->m_prioritypooling && ths->m_wpool->tasksPPending()) {
-			Task *task = ths->m_wpool->getPTask();
+		else {
+			// the relaxed engine is popped without the pool lock
+			bool relaxed = m_wpool->m_relaxed != NULL;
+			if (!relaxed) {
+				m_wpool->m_mutex->lock();
+			}
+			task = m_wpool->popPTask(thread->m_reserved);
 			if (task != NULL) {
-				ths->submit(task);
+				if (!relaxed) {
+					m_wpool->m_mutex->unlock();
+				}
+				if (m_dropExpired && task->m_deadline >= 0
+						&& task->m_deadline < Timer::getCurrentTime()) {
+					drop(task);
+					continue;
+				}
+				thread->checkout(task);
+				checkGrowth(m_wpool->queued(), true);
+				break;
+			}
+			if (relaxed) {
+				m_wpool->m_mutex->lock();
+			}
+		}
+		bool running = m_runFlag;
+		bool work = running && hasWork(thread);
+		m_wpool->m_mutex->unlock();
+		if (!running) {
+			break;
+		}
+		if (work || spin(thread)) {
+			continue;
+		}
+		// the key is taken before the thread turns IDLE and checks
+		// once more, a producer that pushed after the check pops and
+		// claims it
+		EventCount *parking = &thread->m_parking;
+		unsigned int key = parking->prepareWait();
+		thread->checkout(NULL);
+		atomicStore(&thread->m_state, PoolThread::IDLE);
+		pushIdle(thread);
+		m_wpool->m_mutex->lock();
+		running = m_runFlag;
+		work = running && hasWork(thread);
+		m_wpool->m_mutex->unlock();
+		if (!running || work) {
+			// a claim meanwhile is overwritten, the thread looks anyway
+			atomicStore(&thread->m_state, PoolThread::RUNNING);
+			unstackIdle(thread);
+			parking->cancelWait();
+			if (!running) {
+				break;
+			}
+			continue;
+		}
+		// idle reserved threads must not hold back growth
+		volatile int *sleepers = thread->m_reserved ? &m_reservedSleepers : &m_sleepers;
+		atomicAdd(sleepers, 1);
+		bool woken = true;
+		if (atomicLoad(&m_liveThreads, __ATOMIC_RELAXED) <= m_initThreads
+				|| m_keepAlive <= 0 || thread->m_reserved) {
+			parking->wait(key);
+		}
+		else {
+			woken = parking->wait(key, m_keepAlive);
+		}
+		atomicSub(sleepers, 1);
+		if (!woken) {
+			m_wpool->m_mutex->lock();
+			int idle = PoolThread::IDLE;
+			if (m_liveThreads > m_initThreads && !hasWork(thread)
+					&& atomicCas(&thread->m_state, idle, PoolThread::STOPPING)) {
+				// nothing arrived within the keep-alive, the surplus
+				// thread leaves and its slot may be restarted by grow()
+				atomicSub(&m_liveThreads, 1);
+				m_wpool->m_mutex->unlock();
+				unstackIdle(thread);
+				return NULL;
 			}
+			m_wpool->m_mutex->unlock();
 		}
-		Thread::mSleep(1);
-		ths->m_mutex->lock();
-		fl = ths->m_runFlag;
-		ths->m_mutex->unlock();
+		atomicStore(&thread->m_state, PoolThread::RUNNING);
+		unstackIdle(thread);
 	}
-	ths->m_mutex->lock();
-	ths->m_complete = true;
-	ths->m_mutex->unlock();
-	return NULL;
+	if (task == NULL) {
+		atomicStore(&thread->m_state, PoolThread::STOPPING);
+	}
+	return task;
 }
 
-void ThreadPool::submit(Task *task)
+Task* ThreadPool::findTask(PoolThread *thread)
 {
-	bool flag = true;
-	while (flag) {
-		for (size_t var = 0; var < m_tpool->size(); ++var) {
-			if (m_tpool->at(var)->isIdle()) {
-			    m_tpool->at(var)->checkout(task);
-				flag = false;
-				break;
+	Task *task = thread->m_deque->take();
+	if (task == NULL && m_wpool->nodes() > 1) {
+		task = m_wpool->getNodeTask(thread->m_node);
+	}
+	if (task == NULL) {
+		task = m_wpool->getTask();
+		if (task != NULL) {
+			// a burst may have been queued while every thread looked
+			// parked, keep growing while the backlog persists
+			checkGrowth(m_wpool->queued(), true);
+		}
+	}
+	if (task == NULL) {
+		task = steal(thread);
+	}
+	return task;
+}
+
+Task* ThreadPool::steal(PoolThread *thread)
+{
+	size_t count = atomicLoad(&m_threadCount, __ATOMIC_ACQUIRE);
+	int passes = m_wpool->nodes() > 1 ? 2 : 1;
+	if (count < 2 && passes == 1) {
+		return NULL;
+	}
+	size_t start = thread->nextRandom() % count;
+	// the thief's own node first, the queues and threads of the
+	// other nodes only once it ran dry
+	for (int pass = 0; pass < passes; ++pass) {
+		if (pass == 1) {
+			Task *task = m_wpool->getRemoteTask(thread->m_node);
+			if (task != NULL) {
+				return task;
+			}
+		}
+		for (size_t i = 0; i < count; ++i) {
+			PoolThread *victim = &m_workers[(start + i) % count];
+			if (victim == thread || (victim->m_node == thread->m_node) != (pass == 0)) {
+				continue;
+			}
+			Task *task = victim->m_deque->steal();
+			if (task != NULL) {
+				return task;
 			}
 		}
-		Thread::mSleep(1);
 	}
+	return NULL;
 }
 
-void ThreadPool::joinAll()
+bool ThreadPool::spin(PoolThread *thread)
 {
-	while (!m_joinComplete) {
-		if (!m_prioritypooling) {
-			while (m_wpool->tasksPending()) {
-				Thread::sSleep(1);
+	// reserved threads would spin on tasks they may not take
+	if (thread->m_spinBudget <= 0 || thread->m_reserved) {
+		return false;
+	}
+	long long until = Timer::getCurrentTime() + thread->m_spinBudget;
+	do {
+		for (int i = 0; i < 32; ++i) {
+			cpuRelax();
+		}
+		if (mayHaveWork()) {
+			// spinning paid off, allow a longer spin next time
+			thread->m_spinBudget = thread->m_spinBudget * 2 > m_spinNanos
+					? m_spinNanos : thread->m_spinBudget * 2;
+			return true;
+		}
+	} while (Timer::getCurrentTime() < until);
+	// shorter spins while the pool stays idle, never below an eighth
+	thread->m_spinBudget = thread->m_spinBudget / 2 < m_spinNanos / 8
+			? m_spinNanos / 8 : thread->m_spinBudget / 2;
+	return false;
+}
+
+bool ThreadPool::mayHaveWork()
+{
+	if (m_prioritypooling && m_wpool->m_relaxed != NULL) {
+		return !m_wpool->m_relaxed->empty();
+	}
+	if (m_wpool->queued() > 0) {
+		return true;
+	}
+	if (m_prioritypooling) {
+		return false;
+	}
+	size_t count = atomicLoad(&m_threadCount, __ATOMIC_ACQUIRE);
+	for (size_t i = 0; i < count; ++i) {
+		if (!m_workers[i].m_deque->empty()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ThreadPool::hasWork(PoolThread *thread)
+{
+	if (m_prioritypooling) {
+		return m_wpool->hasPTasks(thread->m_reserved);
+	}
+	if (m_wpool->hasTasks()) {
+		return true;
+	}
+	for (int var = 0; var < m_threadCount; ++var) {
+		if (!m_workers[var].m_deque->empty()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::notify(size_t count, int node, size_t reservable)
+{
+	// the stacks are read after the push: a PoolThread that turned
+	// IDLE before is claimed here, a later one finds the work itself
+	atomicFence();
+	if (reservable > 0) {
+		// a regular thread takes what the reserved ones leave
+		count -= claimIdle(&m_idleStacks[m_idleStackCount],
+				reservable < count ? reservable : count);
+	}
+	// the stack of node first, the other nodes steal the rest
+	int first = node >= 0 && node < m_idleStackCount ? node : 0;
+	for (int i = 0; i < m_idleStackCount && count > 0; ++i) {
+		count -= claimIdle(&m_idleStacks[(first + i) % m_idleStackCount], count);
+	}
+}
+
+size_t ThreadPool::claimIdle(IdleStack *stack, size_t count)
+{
+	size_t claimed = 0;
+	while (claimed < count) {
+		// the most recently parked thread, its cache is the warmest
+		// and it may not have reached the futex yet
+		PoolThread *thread = popIdle(stack);
+		if (thread == NULL) {
+			break;
+		}
+		if (thread->claim()) {
+			++claimed;
+		}
+	}
+	return claimed;
+}
+
+ThreadPool::IdleStack* ThreadPool::idleStack(PoolThread *thread)
+{
+	return &m_idleStacks[thread->m_reserved ? m_idleStackCount : thread->m_node];
+}
+
+void ThreadPool::pushIdle(PoolThread *thread)
+{
+	if (atomicExchange(&thread->m_stacked, 1) != 0) {
+		// an entry from an earlier park is still buried in the stack,
+		// a producer reaches the thread there
+		return;
+	}
+	IdleStack *stack = idleStack(thread);
+	unsigned long long slot = static_cast<unsigned long long>(thread - m_workers) + 1;
+	unsigned long long top = atomicLoad(&stack->m_top, __ATOMIC_RELAXED);
+	do {
+		atomicStore(&thread->m_nextIdle, static_cast<unsigned int>(top), __ATOMIC_RELAXED);
+	} while (!atomicCas(&stack->m_top, top, ((top >> 32) + 1) << 32 | slot));
+}
+
+PoolThread* ThreadPool::popIdle(IdleStack *stack)
+{
+	unsigned long long top = atomicLoad(&stack->m_top, __ATOMIC_ACQUIRE);
+	while (static_cast<unsigned int>(top) != 0) {
+		// slots are never freed, a stale read of the link is caught
+		// by the count
+		PoolThread *thread = &m_workers[static_cast<unsigned int>(top) - 1];
+		unsigned long long next = atomicLoad(&thread->m_nextIdle, __ATOMIC_RELAXED);
+		if (atomicCas(&stack->m_top, top, ((top >> 32) + 1) << 32 | next)) {
+			// the caller claims the thread, or it pushes itself again
+			// when it next turns IDLE
+			atomicStore(&thread->m_stacked, 0);
+			return thread;
+		}
+	}
+	return NULL;
+}
+
+void ThreadPool::unstackIdle(PoolThread *thread)
+{
+	IdleStack *stack = idleStack(thread);
+	unsigned long long slot = static_cast<unsigned long long>(thread - m_workers) + 1;
+	unsigned long long top = atomicLoad(&stack->m_top);
+	// only from the top, a buried entry stays until a producer pops
+	// and drops it
+	if (static_cast<unsigned int>(top) == slot
+			&& atomicCas(&stack->m_top, top, ((top >> 32) + 1) << 32 | thread->m_nextIdle)) {
+		atomicStore(&thread->m_stacked, 0);
+	}
+}
+
+bool ThreadPool::enqueue(Task *task, int node)
+{
+	// counted before any PoolThread can see the task
+	atomicAdd(&m_outstanding, 1L);
+	if (m_prioritypooling) {
+		// asked before the push, a PoolThread may finish the task
+		// right after it
+		size_t reservable = m_wpool->m_ptasks->reservable(task) ? 1 : 0;
+		m_wpool->addPTask(task);
+		notify(1, -1, reservable);
+		checkGrowth(m_wpool->queued(), true);
+		return true;
+	}
+	PoolThread *thread = PoolThread::current();
+	bool delayed = task->m_type >= 0 && task->m_type <= 6 && task->m_tunit > 0;
+	int nodes = m_wpool->nodes();
+	if (node >= nodes) {
+		node = -1;
+	}
+	if (thread != NULL && thread->m_pool == this && !delayed
+			&& (node < 0 || node == thread->m_node)) {
+		thread->m_deque->push(task);
+		notify(1, thread->m_node);
+		checkGrowth(thread->m_deque->size(), false);
+		return true;
+	}
+	if (!delayed && nodes > 1) {
+		if (node < 0) {
+			node = currentNode();
+		}
+		// a full ring, or a CPU outside the pool, leaves the
+		// task to the shared queue
+		if (node >= 0 && m_wpool->addNodeTask(task, node)) {
+			notify(1, node);
+			checkGrowth(m_wpool->queued(), true);
+			return true;
+		}
+	}
+	if (!m_wpool->addTask(task)) {
+		finished();
+		return false;
+	}
+	if (!delayed) {
+		notify();
+		checkGrowth(m_wpool->queued(), true);
+	}
+	return true;
+}
+
+size_t ThreadPool::enqueue(Task **tasks, size_t count)
+{
+	if (count == 0) {
+		return 0;
+	}
+	atomicAdd(&m_outstanding, static_cast<long>(count));
+	PoolThread *thread = PoolThread::current();
+	if (!m_prioritypooling && thread != NULL && thread->m_pool == this) {
+		for (size_t i = 0; i < count; ++i) {
+			thread->m_deque->push(tasks[i]);
+		}
+		notify(count);
+		checkGrowth(thread->m_deque->size(), false);
+		return count;
+	}
+	if (!m_prioritypooling && m_wpool->m_ring != NULL) {
+		size_t added = m_wpool->addTasks(tasks, count);
+		for (size_t i = added; i < count; ++i) {
+			finished();
+		}
+		if (added > 0) {
+			notify(added);
+			checkGrowth(m_wpool->queued(), true);
+		}
+		return added;
+	}
+	size_t reservable = 0;
+	m_wpool->m_mutex->lock();
+	for (size_t i = 0; i < count; ++i) {
+		if (m_prioritypooling) {
+			if (m_wpool->m_ptasks->reservable(tasks[i])) {
+				++reservable;
 			}
+			m_wpool->pushPTask(tasks[i]);
 		}
 		else {
-			while (m_wpool->tasksPPending()) {
-				Thread::sSleep(1);
+			m_wpool->pushReady(tasks[i]);
+		}
+	}
+	m_wpool->m_mutex->unlock();
+	notify(count, -1, reservable);
+	checkGrowth(m_wpool->queued(), true);
+	return count;
+}
+
+size_t ThreadPool::enqueueRuns(Task **tasks, size_t count)
+{
+	size_t queued = 0;
+	size_t first = 0;
+	for (size_t i = 0; i <= count; ++i) {
+		if (i < count && tasks[i] != NULL) {
+			continue;
+		}
+		if (i > first) {
+			size_t added = enqueue(tasks + first, i - first);
+			queued += added;
+			if (added < i - first) {
+				// the queue is full, the later runs would be refused too
+				break;
 			}
 		}
-		int i = 0;
-		for (size_t var = 0; var < m_tpool->size(); ++var) {
-			if (m_tpool->at(var)->isIdle()) {
-				++i;
+		first = i + 1;
+	}
+	return queued;
+}
+
+void ThreadPool::checkGrowth(long backlog, bool aged)
+{
+	if (atomicLoad(&m_liveThreads, __ATOMIC_RELAXED) >= m_maxThreads
+			|| atomicLoad(&m_sleepers) > 0) {
+		return;
+	}
+	bool needed = backlog >= m_growBacklog;
+	if (!needed && aged && backlog > 0 && m_growAge > 0) {
+		long long age = Timer::getCurrentTime() - m_wpool->lastTake();
+		needed = age >= m_growAge * 1000000LL;
+	}
+	if (needed) {
+		grow();
+	}
+}
+
+void ThreadPool::grow()
+{
+	m_wpool->m_mutex->lock();
+	if (m_started && m_runFlag && m_liveThreads < m_maxThreads) {
+		PoolThread *thread = NULL;
+		for (int var = 0; var < m_threadCount; ++var) {
+			if (m_workers[var].state() == PoolThread::STOPPING) {
+				thread = &m_workers[var];
+				break;
 			}
 		}
-		if (i == m_initThreads) {
-		    m_joinComplete = true;
-			break;
+		if (thread != NULL) {
+			// reap the retired run before the slot starts over
+			thread->m_thread->join();
+			atomicStore(&thread->m_state, PoolThread::RUNNING);
+			thread->m_thread->execute();
 		}
 		else {
-			Thread::sSleep(1);
+			thread = createThread();
+			thread->execute();
+		}
+		atomicAdd(&m_liveThreads, 1);
+	}
+	m_wpool->m_mutex->unlock();
+}
+
+void ThreadPool::finished()
+{
+	if (atomicSub(&m_outstanding, 1L) == 0) {
+		m_idleCond->lock();
+		m_idleCond->broadcast();
+		m_idleCond->unlock();
+	}
+}
+
+bool ThreadPool::attach(Task **tasks, size_t count, Task *next, bool any)
+{
+	if (next == NULL) {
+		return false;
+	}
+	// continuations are never delayed, they keep their priority
+	next->m_tunit = -1;
+	next->m_type = -1;
+	// a NULL predecessor counts as finished
+	long live = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (tasks[i] != NULL) {
+			++live;
+		}
+	}
+	if (live == 0 || (any && live < static_cast<long>(count))) {
+		return enqueue(next);
+	}
+	Join *join = new Join(next, any ? 1 : live, live);
+	for (size_t i = 0; i < count; ++i) {
+		if (tasks[i] == NULL) {
+			continue;
+		}
+		Successor *link = new Successor(join);
+		Successor *head = atomicLoad(&tasks[i]->m_successors, __ATOMIC_RELAXED);
+		do {
+			link->m_next = head;
+		} while (!atomicCas(&tasks[i]->m_successors, head, link));
+	}
+	return true;
+}
+
+bool ThreadPool::then(Task *first, Task *next)
+{
+	return attach(&first, 1, next, false);
+}
+
+bool ThreadPool::whenAll(Task **tasks, size_t count, Task *next)
+{
+	return attach(tasks, count, next, false);
+}
+
+bool ThreadPool::whenAny(Task **tasks, size_t count, Task *next)
+{
+	return attach(tasks, count, next, true);
+}
+
+void ThreadPool::drop(Task *task)
+{
+	// accounted like a run, the continuations still follow
+	Successor *successors = task->m_successors;
+	task->m_successors = NULL;
+	atomicAdd(&m_deadlineMisses, 1LL);
+	atomicAdd(&m_deadlineDrops, 1LL);
+	task->expired();
+	if (successors != NULL) {
+		resume(successors);
+	}
+	finished();
+}
+
+long long ThreadPool::deadlineMisses()
+{
+	return atomicLoad(&m_deadlineMisses, __ATOMIC_RELAXED);
+}
+
+long long ThreadPool::deadlineDrops()
+{
+	return atomicLoad(&m_deadlineDrops, __ATOMIC_RELAXED);
+}
+
+bool ThreadPool::priorityStats(int priority, PriorityStats &stats)
+{
+	if (!m_prioritypooling || m_wpool->m_deadlines != NULL || m_wpool->m_relaxed != NULL) {
+		return false;
+	}
+	m_wpool->m_mutex->lock();
+	bool found = m_wpool->m_ptasks->stats(priority, stats);
+	m_wpool->m_mutex->unlock();
+	return found;
+}
+
+void ThreadPool::resume(Successor *successors)
+{
+	while (successors != NULL) {
+		Successor *link = successors;
+		Join *join = link->m_join;
+		successors = link->m_next;
+		delete link;
+		// later predecessors of a whenAny() drive m_pending below 0;
+		// queued on the calling PoolThread's deque, next to the data
+		// its predecessor left in cache
+		if (atomicSub(&join->m_pending, 1L) == 0) {
+			enqueue(join->m_task);
 		}
+		if (atomicSub(&join->m_refs, 1L) == 0) {
+			delete join;
+		}
+	}
+}
+
+void ThreadPool::joinAll()
+{
+	m_idleCond->lock();
+	while (atomicLoad(&m_outstanding) > 0) {
+		m_idleCond->wait();
 	}
+	m_idleCond->unlock();
 }
 
-void ThreadPool::execute(Task *task, int priority)
+bool ThreadPool::waitIdle(long milliseconds)
 {
-    if (task != NULL) {
-        task->m_tunit = -1;
-        task->m_type = -1;
-        task->m_priority = priority;
-        if (!m_prioritypooling) {
-            m_wpool->addTask(task);
-        }
-        else {
-            m_wpool->addPTask(task);
-        }
+	Timer timer;
+	timer.start();
+	m_idleCond->lock();
+	bool idle = atomicLoad(&m_outstanding) == 0;
+	while (!idle) {
+		long left = milliseconds - static_cast<long>(timer.elapsedMilliSeconds());
+		if (left <= 0) {
+			break;
+		}
+		m_idleCond->wait(left);
+		idle = atomicLoad(&m_outstanding) == 0;
+	}
+	m_idleCond->unlock();
+	return idle;
+}
+
+int ThreadPool::concurrency() const
+{
+	return m_maxThreads;
+}
+
+bool ThreadPool::execute(Task *task, int priority)
+{
+    if (task == NULL) {
+        return false;
     }
+    task->m_tunit = -1;
+    task->m_type = -1;
+    task->m_priority = priority;
+    task->m_deadline = -1;
+    return enqueue(task);
 }
 
-void ThreadPool::execute(Task &task, int priority)
+bool ThreadPool::execute(Task &task, int priority)
 {
 	task.m_tunit = -1;
 	task.m_type = -1;
 	task.m_priority = priority;
-	if (!m_prioritypooling) {
-	    m_wpool->addTask(task);
-	}
-	else {
-	    m_wpool->addPTask(task);
-	}
+	task.m_deadline = -1;
+	return enqueue(&task);
+}
+
+bool ThreadPool::executeOn(Task *task, int node)
+{
+    if (task == NULL) {
+        return false;
+    }
+    task->m_tunit = -1;
+    task->m_type = -1;
+    task->m_priority = -1;
+    task->m_deadline = -1;
+    return enqueue(task, node);
 }
 
-void ThreadPool::execute(Task *task)
+bool ThreadPool::executeOn(Task &task, int node)
 {
-    if (task != NULL) {
-        task->m_tunit = -1;
-        task->m_type = -1;
-        task->m_priority = -1;
-        if (!m_prioritypooling) {
-            m_wpool->addTask(task);
-        }
-        else {
-            m_wpool->addPTask(task);
-        }
+	return executeOn(&task, node);
+}
+
+bool ThreadPool::executeWithin(Task *task, long long tunit, int type)
+{
+    if (task == NULL) {
+        return false;
     }
+    task->m_tunit = -1;
+    task->m_type = -1;
+    task->m_priority = -1;
+    task->m_deadline = Timer::getCurrentTime() + TimeUnit::toNanoSeconds(tunit, type);
+    return enqueue(task);
 }
 
-void ThreadPool::execute(Task &task)
+bool ThreadPool::executeWithin(Task &task, long long tunit, int type)
+{
+	return executeWithin(&task, tunit, type);
+}
+
+bool ThreadPool::execute(Task *task)
+{
+    if (task == NULL) {
+        return false;
+    }
+    task->m_tunit = -1;
+    task->m_type = -1;
+    task->m_priority = -1;
+    task->m_deadline = -1;
+    return enqueue(task);
+}
+
+bool ThreadPool::execute(Task &task)
 {
 	task.m_tunit = -1;
 	task.m_type = -1;
 	task.m_priority = -1;
-	if (!m_prioritypooling) {
-	    m_wpool->addTask(task);
+	task.m_deadline = -1;
+	return enqueue(&task);
+}
+
+ScheduleHandle ThreadPool::schedule(Task *task, long long tunit, int type)
+{
+    if (task == NULL) {
+        return ScheduleHandle();
+    }
+    task->m_tunit = tunit;
+    task->m_type = type;
+    task->m_priority = -1;
+    if (!defers(tunit, type)) {
+        enqueue(task);
+        return ScheduleHandle();
+    }
+    atomicAdd(&m_outstanding, 1L);
+    long long deadline = Timer::getCurrentTime() + TimeUnit::toNanoSeconds(tunit, type);
+    unsigned int generation = 0;
+    TimerEntry *entry = m_wpool->addScheduled(task, deadline, generation);
+    return ScheduleHandle(this, entry, generation);
+}
+
+ScheduleHandle ThreadPool::schedule(Task &task, long long tunit, int type)
+{
+	return schedule(&task, tunit, type);
+}
+
+bool ThreadPool::defers(long long tunit, int type) const
+{
+	bool delayed = type >= TimeUnit::NANOSECONDS && type <= TimeUnit::DAYS && tunit > 0;
+	return delayed && !m_prioritypooling;
+}
+
+bool ThreadPool::cancel(TimerEntry *entry, unsigned int generation)
+{
+	bool periodic = entry->m_period > 0;
+	bool removed = false;
+	if (!m_wpool->cancelScheduled(entry, generation, removed)) {
+		return false;
 	}
-	else {
-	    m_wpool->addPTask(task);
+	// a one-shot task will never run, joinAll() stops waiting for it;
+	// periodic ones are not counted while they wait
+	if (removed && !periodic) {
+		finished();
 	}
+	return true;
 }
 
-void ThreadPool::schedule(Task *task, long long tunit, int type)
+ScheduleHandle ThreadPool::scheduleAtFixedRate(Task *task, long long delay, long long period, int type)
 {
-    if (task != NULL) {
-        task->m_tunit = tunit;
-        task->m_type = type;
-        task->m_priority = -1;
-        if (!m_prioritypooling) {
-            m_wpool->addTask(task);
-        }
-        else {
-            m_wpool->addPTask(task);
-        }
-    }
+	return schedulePeriodic(task, delay, period, type, true);
 }
 
-void ThreadPool::schedule(Task &task, long long tunit, int type)
+ScheduleHandle ThreadPool::scheduleAtFixedRate(Task &task, long long delay, long long period, int type)
 {
-	task.m_tunit = tunit;
-	task.m_type = type;
-	task.m_priority = -1;
-	if (!m_prioritypooling) {
-	    m_wpool->addTask(task);
+	return schedulePeriodic(&task, delay, period, type, true);
+}
+
+ScheduleHandle ThreadPool::scheduleWithFixedDelay(Task *task, long long delay, long long period, int type)
+{
+	return schedulePeriodic(task, delay, period, type, false);
+}
+
+ScheduleHandle ThreadPool::scheduleWithFixedDelay(Task &task, long long delay, long long period, int type)
+{
+	return schedulePeriodic(&task, delay, period, type, false);
+}
+
+ScheduleHandle ThreadPool::schedulePeriodic(Task *task, long long delay, long long period,
+		int type, bool fixedRate)
+{
+	long long interval = TimeUnit::toNanoSeconds(period, type);
+	if (task == NULL || interval <= 0) {
+		return ScheduleHandle();
 	}
-	else {
-	    m_wpool->addPTask(task);
+	// the entry is allocated from the wheel under its lock
+	m_wpool->m_timerCond->lock();
+	TimerEntry *entry = m_wpool->m_wheel->allocate();
+	m_wpool->m_timerCond->unlock();
+	entry->m_task = task;
+	entry->m_due = Timer::getCurrentTime() + TimeUnit::toNanoSeconds(delay, type);
+	entry->m_period = interval;
+	entry->m_fixedRate = fixedRate;
+	entry->m_pool = this;
+	entry->m_priority = task->m_priority;
+	unsigned int generation = 0;
+	m_wpool->addPeriodic(entry, generation);
+	return ScheduleHandle(this, entry, generation);
+}
+
+void ThreadPool::runPeriodic(TimerEntry *entry)
+{
+	// balances the finished() of this run, a periodic entry is
+	// not counted while it waits in the wheel
+	atomicAdd(&m_outstanding, 1L);
+	if (!atomicLoad(&entry->m_cancelled)) {
+		try {
+			entry->m_task->run();
+		}
+		catch(std::exception &e) {
+			std::cerr << e.what() << std::endl;
+		}
+		catch(...) {
+			std::cerr << "periodic task catch exception !" << std::endl;
+		}
 	}
+	m_wpool->rearm(entry);
 }
 
-ThreadPool::~ThreadPool()
+bool ThreadPool::reschedule(TimerEntry *entry, unsigned int generation, long long tunit, int type)
+{
+	long long deadline = Timer::getCurrentTime() + TimeUnit::toNanoSeconds(tunit, type);
+	return m_wpool->reschedule(entry, generation, deadline);
+}
+
+bool ThreadPool::isPending(TimerEntry *entry, unsigned int generation)
+{
+	return m_wpool->isScheduled(entry, generation);
+}
+
+size_t ThreadPool::executeBatch(Task **tasks, size_t count)
+{
+	return executeBatch(tasks, count, -1);
+}
+
+size_t ThreadPool::executeBatch(Task **tasks, size_t count, int priority)
+{
+	for (size_t i = 0; i < count; ++i) {
+		if (tasks[i] != NULL) {
+			tasks[i]->m_tunit = -1;
+			tasks[i]->m_type = -1;
+			tasks[i]->m_priority = priority;
+			tasks[i]->m_deadline = -1;
+		}
+	}
+	return enqueueRuns(tasks, count);
+}
+
+size_t ThreadPool::executeBatch(std::vector<Task*> &tasks)
 {
-	while(!m_joinComplete) {
-		joinAll();
-		Thread::mSleep(1);
+	if (tasks.empty()) {
+		return 0;
 	}
-	this->m_mutex->lock();
-	this->m_runFlag = false;
-	this->m_mutex->unlock();
+	return executeBatch(&tasks[0], tasks.size(), -1);
+}
 
-	m_mutex->lock();
-	bool fl = this->m_complete;
-	m_mutex->unlock();
-	while(!fl) {
-		m_mutex->lock();
-		fl = this->m_complete;
-		m_mutex->unlock();
-		Thread::mSleep(1);
+void ThreadPool::scheduleBatch(Task **tasks, size_t count, long long tunit, int type)
+{
+	long valid = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (tasks[i] != NULL) {
+			tasks[i]->m_tunit = tunit;
+			tasks[i]->m_type = type;
+			tasks[i]->m_priority = -1;
+			++valid;
+		}
+	}
+	if (!defers(tunit, type)) {
+		// like schedule(), priority pools and tasks without
+		// a delay go to the ready queues right away
+		enqueueRuns(tasks, count);
+		return;
+	}
+	atomicAdd(&m_outstanding, valid);
+	long long deadline = Timer::getCurrentTime() + TimeUnit::toNanoSeconds(tunit, type);
+	m_wpool->m_timerCond->lock();
+	for (size_t i = 0; i < count; ++i) {
+		if (tasks[i] != NULL) {
+			m_wpool->pushScheduled(tasks[i], deadline);
+		}
+	}
+	m_wpool->m_timerCond->unlock();
+}
+
+ThreadPool::~ThreadPool()
+{
+	if (m_wpool == NULL) {
+	    return;
+	}
+	joinAll();
+	m_wpool->m_mutex->lock();
+	m_runFlag = false;
+	m_wpool->m_mutex->unlock();
+	for (int i = 0; i < m_threadCount; ++i) {
+		m_workers[i].m_parking.notifyAll();
+	}
+	// every PoolThread has to be gone before any deque is freed,
+	// a late thief may still look into its neighbours
+	for (int i = 0; i < m_threadCount; ++i) {
+		m_workers[i].m_thread->join();
 	}
-	delete m_poller;
+	// the timer thread notifies through m_workers until it is stopped
 	delete m_wpool;
-	for (size_t i = 0; i < m_tpool->size(); ++i) {
-		delete m_tpool->at(i);
+	for (int i = 0; i < m_threadCount; ++i) {
+		m_workers[i].~PoolThread();
 	}
-	delete m_mutex;
+	free(m_workers);
+	delete[] m_idleStacks;
+	delete m_idleCond;
+	delete m_functions;
 }
 
 } // namespace TTP
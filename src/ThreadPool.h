@@ -10,44 +10,282 @@
 #include <vector>
 #include "TaskPool.h"
 #include "PoolThread.h"
+#include "PoolOptions.h"
+#include "Future.h"
+#include "TaskGroup.h"
+#include "FunctionTask.h"
+#include "ScheduleHandle.h"
 
 namespace TTP
 {
 
 class ThreadPool
 {
+    friend class PoolThread;
+    friend class TaskPool;
+    friend class ScheduleHandle;
+    friend class TimerEntry;
+    friend class ScheduleAwaiter;
+    friend class TaskGroup;
 public:
 	ThreadPool();
     ThreadPool(int initThreads, int maxThreads);
     ThreadPool(int initThreads, int maxThreads, int lowp, int highp);
+    explicit ThreadPool(const PoolOptions &options);
 	virtual ~ThreadPool();
 	void start();
 	void init(int initThreads, int maxThreads);
+	// blocks until every submitted task, delayed ones included, has
+	// finished; must not be called from a task of this pool
 	void joinAll();
-    void execute(Task *task, int priority);
-	void execute(Task &task, int priority);
-    void execute(Task *task);
-	void execute(Task &task);
-    void schedule(Task *task, long long tunit, int type);
-	void schedule(Task &task, long long tunit, int type);
-	static void* poll(void *arg);
+	// like joinAll() but gives up after milliseconds, returns true
+	// if the pool ran out of work
+	bool waitIdle(long milliseconds);
+	// the most PoolThreads that may run tasks at the same time
+	int concurrency() const;
+    // the execute() calls return false if the task was not queued
+    // because a bounded queue is full
+    bool execute(Task *task, int priority);
+	bool execute(Task &task, int priority);
+    bool execute(Task *task);
+	bool execute(Task &task);
+    // the handle cancels or reschedules the task while it waits,
+    // it is empty if the task was queued right away
+    ScheduleHandle schedule(Task *task, long long tunit, int type);
+	ScheduleHandle schedule(Task &task, long long tunit, int type);
+	// run task after delay and then every period, both in type units,
+	// until the handle cancels it; the task must stay alive until then.
+	// Fixed rate keeps to the grid of the first run and coalesces the
+	// periods missed under overload into one run, fixed delay waits a
+	// period after each run. A run never overlaps the previous one.
+	// joinAll() does not wait for periodic tasks.
+	ScheduleHandle scheduleAtFixedRate(Task *task, long long delay, long long period, int type);
+	ScheduleHandle scheduleAtFixedRate(Task &task, long long delay, long long period, int type);
+	ScheduleHandle scheduleWithFixedDelay(Task *task, long long delay, long long period, int type);
+	ScheduleHandle scheduleWithFixedDelay(Task &task, long long delay, long long period, int type);
+	// queue count tasks under one lock (or one CAS of the ring engine)
+	// and wake at most as many parked PoolThreads as tasks were queued,
+	// returns the number of tasks queued; NULL entries are skipped and
+	// not counted
+	size_t executeBatch(Task **tasks, size_t count);
+	size_t executeBatch(Task **tasks, size_t count, int priority);
+	size_t executeBatch(std::vector<Task*> &tasks);
+	void scheduleBatch(Task **tasks, size_t count, long long tunit, int type);
+	// execute a Callable, the Future delivers its value or exception
+	// as soon as the PoolThread finished it
+	template <typename T>
+	Future<T> submit(Callable<T> *task);
+	template <typename T>
+	Future<T> submit(Callable<T> &task);
+	template <typename T>
+	Future<T> submit(Callable<T> *task, int priority);
+	// queue a copy of any functor or function pointer, called as fn()
+	// on a PoolThread; no Task subclass and, for functors up to
+	// FunctionTask::STORAGE bytes, no allocation
+	template <typename F>
+	typename EnableIf<!IsTask<F>::value, bool>::type execute(const F &fn);
+	template <typename F>
+	typename EnableIf<!IsTask<F>::value, bool>::type execute(const F &fn, int priority);
+	// continuations: next is queued once first, all or any of tasks
+	// finished, on the PoolThread that ran the last of them. Attach
+	// before the predecessors are submitted; a predecessor refused by
+	// a full queue keeps its continuations for the next submission.
+	// Returns false if next had to be queued at once and was refused.
+	bool then(Task *first, Task *next);
+	bool whenAll(Task **tasks, size_t count, Task *next);
+	bool whenAny(Task **tasks, size_t count, Task *next);
+	// counters of a priority level, false if this is no priority pool
+	// or priority is outside its range
+	bool priorityStats(int priority, PriorityStats &stats);
+	// queue task to finish within tunit type units, a PRIORITY_DEADLINE
+	// pool runs the nearest deadline first
+	bool executeWithin(Task *task, long long tunit, int type);
+	bool executeWithin(Task &task, long long tunit, int type);
+	// tasks that finished after their deadline or were dropped, and
+	// the dropped ones alone
+	long long deadlineMisses();
+	long long deadlineDrops();
+	// queue task on the queue of NUMA node, below numaNodes(); the
+	// PoolThreads of that node run it unless they are all busy. Any
+	// other node picks the node of the calling thread's CPU. Priority
+	// pools have a single queue and ignore node.
+	bool executeOn(Task *task, int node);
+	bool executeOn(Task &task, int node);
+	// nodes the PoolThreads are spread over, see PoolOptions::m_numaAware
+	int numaNodes() const;
 private:
+	// whether schedule() puts a task with this delay on the timer,
+	// instead of queueing it right away
+	bool defers(long long tunit, int type) const;
+	// throws for an empty or oversized priority range
+	static void checkPriorities(const PoolOptions &options);
+	void configure(const PoolOptions &options);
 	void initializeThreads();
-	void submit(Task *task);
+	// routes a task to the calling PoolThread's deque, the
+	// scheduler, the queue of node or the shared injection queue
+	bool enqueue(Task *task, int node = -1);
+	size_t enqueue(Task **tasks, size_t count);
+	// enqueue() of the runs between NULL entries, up to the first run
+	// a full queue refused in part
+	size_t enqueueRuns(Task **tasks, size_t count);
+	// claims and wakes up to count IDLE PoolThreads after a push, the
+	// most recently parked first and those of node before the others.
+	// Up to reservable of the tasks may go to a reserved PoolThread,
+	// those wake reserved ones first; the rest only regular ones.
+	void notify(size_t count = 1, int node = -1, size_t reservable = 0);
+	// the top of a stack of IDLE PoolThreads: the slot + 1 of the top
+	// one in the low half, a count of the pushes and pops against ABA
+	// in the high half
+	enum { CACHELINE = 64 };
+	struct IdleStack
+	{
+		volatile unsigned long long m_top;
+		char m_pad[CACHELINE];
+	};
+	// the stack of the thread's node, or the one of reserved threads
+	IdleStack* idleStack(PoolThread *thread);
+	// puts a PoolThread that turned IDLE on top of its stack
+	void pushIdle(PoolThread *thread);
+	// takes the top PoolThread off stack, NULL if it is empty; the
+	// thread may have left IDLE meanwhile
+	PoolThread* popIdle(IdleStack *stack);
+	// claims up to count PoolThreads off stack, returns how many
+	size_t claimIdle(IdleStack *stack, size_t count);
+	// takes a PoolThread that leaves IDLE by itself off the stack
+	// again, unless a later push buried it
+	void unstackIdle(PoolThread *thread);
+	// constructs the PoolThread of the next slot, placed on the next
+	// node and pinned to its CPUs, and publishes the slot
+	PoolThread* createThread();
+	// node of the CPU the calling thread runs on, -1 if outside the pool
+	int currentNode() const;
+	// blocks the calling PoolThread until a task is queued,
+	// returns NULL once the pool is shutting down
+	Task* take(PoolThread *thread);
+	// called by a PoolThread after a task returned
+	void finished();
+	// ScheduleHandle operations
+	bool cancel(TimerEntry *entry, unsigned int generation);
+	bool reschedule(TimerEntry *entry, unsigned int generation, long long tunit, int type);
+	bool isPending(TimerEntry *entry, unsigned int generation);
+	ScheduleHandle schedulePeriodic(Task *task, long long delay, long long period,
+			int type, bool fixedRate);
+	// called by a PoolThread for each period of a periodic entry
+	void runPeriodic(TimerEntry *entry);
+	// links next behind tasks, queued once pending of them finished
+	bool attach(Task **tasks, size_t count, Task *next, bool any);
+	// called by a PoolThread with the continuations of a finished task
+	void resume(Successor *successors);
+	Task* findTask(PoolThread *thread);
+	Task* steal(PoolThread *thread);
+	// callers must hold the TaskPool lock
+	bool hasWork(PoolThread *thread);
+	// spins up to the thread's budget for work to show up before it
+	// parks, adapting the budget to whether spinning paid off
+	bool spin(PoolThread *thread);
+	// lock-free and approximate hasWork()
+	bool mayHaveWork();
+	// hands a task whose deadline passed to Task::expired()
+	void drop(Task *task);
+	// adds a PoolThread if the backlog calls for it
+	void checkGrowth(long backlog, bool aged);
+	void grow();
 private:
     int m_maxThreads;
     int m_initThreads;
     int m_lowp;
     int m_highp;
-    std::vector<PoolThread*> *m_tpool;
+    // m_maxThreads slots in one cache line aligned block, a PoolThread
+    // is constructed in the next free slot as the pool grows and never
+    // moves under a thief or a claiming producer
+    PoolThread *m_workers;
+    // slots with a constructed PoolThread, published after construction
+    volatile int m_threadCount;
+    // one per node and behind them one for the reserved threads, the
+    // threads at the bottom stay parked until their keep-alive retires
+    // them
+    IdleStack *m_idleStacks;
+    // the stacks of the nodes
+    int m_idleStackCount;
+    // PoolThreads that have not retired
+    volatile int m_liveThreads;
+    long m_keepAlive;
+    int m_growBacklog;
+    long m_growAge;
+    int m_queueEngine;
+    long m_queueCapacity;
     TaskPool *m_wpool;
-    Thread *m_poller;
     bool m_prioritypooling;
-    volatile bool m_runFlag, m_complete, m_pollerStarted;
-    Mutex *m_mutex;
-    bool m_joinComplete;
+    volatile bool m_runFlag, m_started;
+    // parked PoolThreads
+    volatile int m_sleepers;
+    // parked reserved PoolThreads, apart from m_sleepers
+    volatile int m_reservedSleepers;
+    // submitted tasks that have not finished yet
+    volatile long m_outstanding;
+    // joinAll() and waitIdle() wait on it for m_outstanding to drop to 0
+    Condition *m_idleCond;
+    long m_functionSlots;
+    long m_timerSpin;
+    // upper bound of a PoolThread's spin before it parks, 0 when the
+    // machine has a single CPU
+    long long m_spinNanos;
+    std::vector<int> m_weights;
+    int m_priorityEngine;
+    bool m_dropExpired;
+    int m_multiQueueFactor;
+    volatile long long m_deadlineMisses;
+    volatile long long m_deadlineDrops;
+    int m_reservedThreads;
+    int m_reservedPriority;
+    // the CPUs of each node the PoolThreads are spread over, a single
+    // set without PoolOptions::m_numaAware, none while they float
+    std::vector<std::vector<int> > m_nodeCpus;
+    // node by CPU number, -1 for the CPUs the pool does not use
+    std::vector<int> m_cpuNode;
+    FunctionSlots *m_functions;
 };
 
+template <typename T>
+Future<T> ThreadPool::submit(Callable<T> *task)
+{
+	return submit(task, -1);
+}
+
+template <typename T>
+Future<T> ThreadPool::submit(Callable<T> &task)
+{
+	return submit(&task, -1);
+}
+
+template <typename T>
+Future<T> ThreadPool::submit(Callable<T> *task, int priority)
+{
+	Future<T> future = task->prepare();
+	if (!execute(task, priority)) {
+		task->m_state->fail("task queue is full");
+	}
+	return future;
+}
+
+template <typename F>
+typename EnableIf<!IsTask<F>::value, bool>::type ThreadPool::execute(const F &fn)
+{
+	return execute(fn, -1);
+}
+
+template <typename F>
+typename EnableIf<!IsTask<F>::value, bool>::type ThreadPool::execute(const F &fn, int priority)
+{
+	FunctionTask *task = m_functions->acquire();
+	task->assign(fn);
+	if (!execute(static_cast<Task*>(task), priority)) {
+		task->discard();
+		return false;
+	}
+	return true;
+}
+
 } // namespace TTP
 
 #endif /* THREADPOOL_H_ */
@@ -21,6 +21,17 @@ public:
 	static const int MINUTES = 4;
 	static const int HOURS = 5;
 	static const int DAYS = 6;
+	// duration given in unit, converted to nanoseconds
+	static long long toNanoSeconds(long long duration, int unit) {
+		static const long long factors[] = {
+			1LL, 1000LL, 1000000LL, 1000000000LL,
+			60000000000LL, 3600000000000LL, 86400000000000LL
+		};
+		if (unit < NANOSECONDS || unit > DAYS) {
+			return 0;
+		}
+		return duration * factors[unit];
+	}
 };
 
 } // namespace TTP
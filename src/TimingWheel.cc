@@ -0,0 +1,237 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : TimingWheel.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#include "TimingWheel.h"
+#include "ThreadPool.h"
+
+namespace TTP
+{
+
+namespace
+{
+    const int DUE = TimingWheel::LEVELS * TimingWheel::SLOTS;
+    // deadlines past the top level's current turn (about nine years)
+    // wait here for the clock to start the next turn
+    const int FAR = DUE + 1;
+    const size_t CHUNK = 256;
+    const int SPAN_BITS = TimingWheel::LEVELS * TimingWheel::SLOT_BITS;
+} // namespace anonymous
+
+void TimerEntry::run()
+{
+    m_pool->runPeriodic(this);
+}
+
+TimingWheel::TimingWheel(long long now)
+{
+    for (int i = 0; i <= FAR; ++i) {
+        m_heads[i] = NULL;
+    }
+    for (int i = 0; i < LEVELS; ++i) {
+        m_busy[i] = 0;
+    }
+    m_now = now >> TICK_SHIFT;
+    m_size = 0;
+    m_free = NULL;
+}
+
+TimingWheel::~TimingWheel()
+{
+    for (size_t i = 0; i < m_chunks.size(); ++i) {
+        delete [] m_chunks[i];
+    }
+}
+
+TimerEntry* TimingWheel::allocate()
+{
+    if (m_free == NULL) {
+        TimerEntry *chunk = new TimerEntry[CHUNK];
+        m_chunks.push_back(chunk);
+        for (size_t i = 0; i < CHUNK; ++i) {
+            chunk[i].m_next = m_free;
+            m_free = &chunk[i];
+        }
+    }
+    TimerEntry *entry = m_free;
+    m_free = entry->m_next;
+    entry->m_next = NULL;
+    return entry;
+}
+
+void TimingWheel::release(TimerEntry *entry)
+{
+    entry->m_task = NULL;
+    entry->m_period = 0;
+    entry->m_fixedRate = false;
+    entry->m_cancelled = false;
+    entry->m_pool = NULL;
+    ++entry->m_generation;
+    entry->m_prev = NULL;
+    entry->m_slot = -1;
+    entry->m_next = m_free;
+    m_free = entry;
+}
+
+void TimingWheel::insert(TimerEntry *entry)
+{
+    // rounded up, an entry never fires before its deadline
+    long long tick = (entry->m_due + (1LL << TICK_SHIFT) - 1) >> TICK_SHIFT;
+    if (tick <= m_now) {
+        link(DUE, entry);
+        return;
+    }
+    unsigned long long diff = static_cast<unsigned long long>(tick ^ m_now);
+    int level = (63 - __builtin_clzll(diff)) / SLOT_BITS;
+    if (level >= LEVELS) {
+        link(FAR, entry);
+        return;
+    }
+    int slot = static_cast<int>((tick >> (level * SLOT_BITS)) & (SLOTS - 1));
+    link(level * SLOTS + slot, entry);
+}
+
+void TimingWheel::remove(TimerEntry *entry)
+{
+    if (entry->m_slot >= 0) {
+        unlink(entry);
+    }
+}
+
+void TimingWheel::link(int index, TimerEntry *entry)
+{
+    entry->m_slot = index;
+    entry->m_prev = NULL;
+    entry->m_next = m_heads[index];
+    if (entry->m_next != NULL) {
+        entry->m_next->m_prev = entry;
+    }
+    m_heads[index] = entry;
+    if (index < DUE) {
+        m_busy[index / SLOTS] |= 1ULL << (index % SLOTS);
+    }
+    ++m_size;
+}
+
+TimerEntry* TimingWheel::take(int index)
+{
+    TimerEntry *entry = m_heads[index];
+    m_heads[index] = NULL;
+    if (index < DUE) {
+        m_busy[index / SLOTS] &= ~(1ULL << (index % SLOTS));
+    }
+    for (TimerEntry *e = entry; e != NULL; e = e->m_next) {
+        e->m_prev = NULL;
+        e->m_slot = -1;
+        --m_size;
+    }
+    return entry;
+}
+
+void TimingWheel::unlink(TimerEntry *entry)
+{
+    int index = entry->m_slot;
+    if (entry->m_prev != NULL) {
+        entry->m_prev->m_next = entry->m_next;
+    }
+    else {
+        m_heads[index] = entry->m_next;
+    }
+    if (entry->m_next != NULL) {
+        entry->m_next->m_prev = entry->m_prev;
+    }
+    if (index < DUE && m_heads[index] == NULL) {
+        m_busy[index / SLOTS] &= ~(1ULL << (index % SLOTS));
+    }
+    entry->m_prev = NULL;
+    entry->m_next = NULL;
+    entry->m_slot = -1;
+    --m_size;
+}
+
+long long TimingWheel::nextTick(int &level, int &slot)
+{
+    long long next = -1;
+    // the first match wins ties, a lower level is expired before the
+    // slot above it is spread out again
+    for (int i = 0; i < LEVELS; ++i) {
+        if (m_busy[i] == 0) {
+            continue;
+        }
+        // busy slots of a level always lie ahead of the clock's
+        // position on that level
+        int busy = __builtin_ctzll(m_busy[i]);
+        int shift = (i + 1) * SLOT_BITS;
+        long long tick = ((m_now >> shift) << shift)
+                       | (static_cast<long long>(busy) << (i * SLOT_BITS));
+        if (next < 0 || tick < next) {
+            next = tick;
+            level = i;
+            slot = busy;
+        }
+    }
+    if (m_heads[FAR] != NULL) {
+        // the top level's next turn brings them into reach
+        long long turn = ((m_now >> SPAN_BITS) + 1) << SPAN_BITS;
+        if (next < 0 || turn < next) {
+            next = turn;
+            level = LEVELS;
+            slot = 0;
+        }
+    }
+    return next;
+}
+
+TimerEntry* TimingWheel::advance(long long now)
+{
+    long long target = now >> TICK_SHIFT;
+    TimerEntry *due = NULL;
+    for (;;) {
+        int level = 0;
+        int slot = 0;
+        long long tick = nextTick(level, slot);
+        if (tick < 0 || tick > target) {
+            break;
+        }
+        m_now = tick;
+        TimerEntry *entry = take(level < LEVELS ? level * SLOTS + slot : FAR);
+        while (entry != NULL) {
+            TimerEntry *next = entry->m_next;
+            // level 0 slots are due, higher ones spread out below
+            insert(entry);
+            entry = next;
+        }
+    }
+    if (target > m_now) {
+        m_now = target;
+    }
+    TimerEntry *entry = take(DUE);
+    while (entry != NULL) {
+        TimerEntry *next = entry->m_next;
+        entry->m_next = due;
+        due = entry;
+        entry = next;
+    }
+    return due;
+}
+
+long long TimingWheel::nextDeadline()
+{
+    if (m_heads[DUE] != NULL) {
+        return m_now << TICK_SHIFT;
+    }
+    int level = 0;
+    int slot = 0;
+    long long tick = nextTick(level, slot);
+    return tick < 0 ? -1 : tick << TICK_SHIFT;
+}
+
+size_t TimingWheel::size() const
+{
+    return m_size;
+}
+
+} // namespace TTP
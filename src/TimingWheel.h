@@ -0,0 +1,112 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : TimingWheel.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef TIMINGWHEEL_H_
+#define TIMINGWHEEL_H_
+#include <vector>
+#include <cstddef>
+#include "Task.h"
+
+namespace TTP
+{
+
+class ThreadPool;
+
+// A pending delayed task, pooled by the TimingWheel. A periodic entry
+// is queued itself each period, its run() runs m_task and arms the
+// entry again.
+class TimerEntry : public Task
+{
+public:
+    TimerEntry()
+    :m_task(NULL)
+    ,m_due(0)
+    ,m_prev(NULL)
+    ,m_next(NULL)
+    ,m_slot(-1)
+    ,m_generation(0)
+    ,m_period(0)
+    ,m_fixedRate(false)
+    ,m_cancelled(false)
+    ,m_pool(NULL)
+    {}
+    void run();
+    Task *m_task;
+    // Timer::getCurrentTime() at which the task is due, apart from
+    // the Task::m_deadline it must have finished by
+    long long m_due;
+    TimerEntry *m_prev;
+    TimerEntry *m_next;
+    // index into the wheel's slot lists, -1 while not in the wheel
+    int m_slot;
+    // bumped each time the entry is released, see ScheduleHandle
+    unsigned int m_generation;
+    // nanoseconds between runs, 0 for a one-shot entry
+    long long m_period;
+    // next deadline on the grid of the first one, or period after
+    // the end of the last run
+    bool m_fixedRate;
+    // set by a cancel() that found the periodic entry running
+    volatile bool m_cancelled;
+    ThreadPool *m_pool;
+};
+
+// Hierarchical timing wheel on absolute deadlines in nanoseconds.
+// LEVELS levels of SLOTS slots each, one slot of level 0 spans one tick
+// of 2^TICK_SHIFT ns (about a microsecond), one slot of level n spans
+// all of level n - 1. An entry sits on the level of the highest bit
+// where its deadline differs from the wheel's current time, so insert
+// and remove are O(1) and an entry moves down at most LEVELS - 1 times
+// before it expires. A bitmap per level finds the next busy slot
+// without walking empty ones. Not thread safe.
+class TimingWheel
+{
+public:
+    static const int LEVELS = 8;
+    static const int SLOTS = 64;
+    static const int SLOT_BITS = 6;
+    static const int TICK_SHIFT = 10;
+public:
+    // now is the current Timer::getCurrentTime()
+    explicit TimingWheel(long long now);
+    ~TimingWheel();
+    // an unused entry, from the pool or a new chunk
+    TimerEntry* allocate();
+    void release(TimerEntry *entry);
+    void insert(TimerEntry *entry);
+    void remove(TimerEntry *entry);
+    // moves the clock to now and unlinks every entry that is due,
+    // returns them as a list chained through m_next
+    TimerEntry* advance(long long now);
+    // the time the next call to advance() will find work,
+    // -1 if the wheel is empty
+    long long nextDeadline();
+    size_t size() const;
+private:
+    // earliest tick at which a busy slot needs attention, -1 if none
+    long long nextTick(int &level, int &slot);
+    void link(int index, TimerEntry *entry);
+    // detaches the list at index, the entries keep their m_next
+    TimerEntry* take(int index);
+    void unlink(TimerEntry *entry);
+private:
+    TimingWheel(const TimingWheel&);
+    TimingWheel& operator = (const TimingWheel&);
+private:
+    // LEVELS * SLOTS slot lists followed by the list of due entries
+    // and the list of entries beyond the top level
+    TimerEntry *m_heads[LEVELS * SLOTS + 2];
+    unsigned long long m_busy[LEVELS];
+    // current time in ticks, every entry is later than this
+    long long m_now;
+    size_t m_size;
+    TimerEntry *m_free;
+    std::vector<TimerEntry*> m_chunks;
+};
+
+} // namespace TTP
+#endif /* TIMINGWHEEL_H_ */
@@ -0,0 +1,142 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : Topology.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+#include "Topology.h"
+
+namespace TTP
+{
+
+Topology::Topology()
+{
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                m_allowed.push_back(cpu);
+            }
+        }
+    }
+    std::vector<int> ids;
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (dir != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            std::string name(entry->d_name);
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0
+                    && name.find_first_not_of("0123456789", 4) == std::string::npos) {
+                ids.push_back(atoi(name.c_str() + 4));
+            }
+        }
+        closedir(dir);
+    }
+    // readdir() does not sort, node ids may have holes
+    std::sort(ids.begin(), ids.end());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        std::ostringstream path;
+        path << "/sys/devices/system/node/node" << ids[i] << "/cpulist";
+        std::ifstream file(path.str().c_str());
+        std::string line;
+        std::vector<int> cpus;
+        if (std::getline(file, line) && parseCpuList(line, cpus)) {
+            addNode(ids[i], cpus);
+        }
+    }
+#endif
+    if (m_cpus.empty()) {
+        std::vector<int> cpus(m_allowed);
+        if (cpus.empty()) {
+            long count = sysconf(_SC_NPROCESSORS_ONLN);
+            for (long cpu = 0; cpu < count; ++cpu) {
+                cpus.push_back(static_cast<int>(cpu));
+            }
+        }
+        m_allowed.clear();
+        addNode(0, cpus);
+    }
+}
+
+void Topology::addNode(int id, const std::vector<int> &cpus)
+{
+    std::vector<int> usable;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        if (m_allowed.empty()
+                || std::binary_search(m_allowed.begin(), m_allowed.end(), cpus[i])) {
+            usable.push_back(cpus[i]);
+        }
+    }
+    if (usable.empty()) {
+        // memory only, or outside the process's CPU set
+        return;
+    }
+    std::sort(usable.begin(), usable.end());
+    m_ids.push_back(id);
+    m_cpus.push_back(usable);
+}
+
+int Topology::nodes() const
+{
+    return static_cast<int>(m_cpus.size());
+}
+
+const std::vector<int>& Topology::cpus(int node) const
+{
+    return m_cpus[node];
+}
+
+int Topology::id(int node) const
+{
+    return m_ids[node];
+}
+
+bool Topology::parseCpuList(const std::string &text, std::vector<int> &cpus)
+{
+    size_t pos = 0;
+    size_t end = text.find_last_not_of(" \t\r\n");
+    if (end == std::string::npos) {
+        // an empty list, a node without CPUs
+        return true;
+    }
+    ++end;
+    while (pos < end) {
+        char *next = NULL;
+        long first = strtol(text.c_str() + pos, &next, 10);
+        size_t stop = static_cast<size_t>(next - text.c_str());
+        if (stop == pos || first < 0) {
+            return false;
+        }
+        long last = first;
+        if (stop < end && text[stop] == '-') {
+            pos = stop + 1;
+            last = strtol(text.c_str() + pos, &next, 10);
+            stop = static_cast<size_t>(next - text.c_str());
+            if (stop == pos || last < first) {
+                return false;
+            }
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        if (stop < end && text[stop] != ',') {
+            return false;
+        }
+        pos = stop + 1;
+    }
+    return true;
+}
+
+} // namespace TTP
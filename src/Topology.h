@@ -0,0 +1,41 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : Topology.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef TOPOLOGY_H_
+#define TOPOLOGY_H_
+#include <string>
+#include <vector>
+
+namespace TTP
+{
+
+// The NUMA nodes of the machine and their CPUs as the kernel lists them
+// under /sys/devices/system/node, restricted to the CPUs the process may
+// run on; nodes without such a CPU are left out. Without sysfs, or off
+// Linux, there is a single node holding every CPU.
+class Topology
+{
+public:
+    Topology();
+    int nodes() const;
+    // CPUs of node in ascending order, node is below nodes()
+    const std::vector<int>& cpus(int node) const;
+    // the kernel's number of node, it may differ from node
+    int id(int node) const;
+    // parses a kernel CPU list like "0-3,8,10-11", false if malformed
+    static bool parseCpuList(const std::string &text, std::vector<int> &cpus);
+private:
+    void addNode(int id, const std::vector<int> &cpus);
+private:
+    std::vector<int> m_ids;
+    std::vector<std::vector<int> > m_cpus;
+    // CPUs the process may run on, empty if unknown
+    std::vector<int> m_allowed;
+};
+
+} // namespace TTP
+#endif /* TOPOLOGY_H_ */
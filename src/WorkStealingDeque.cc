@@ -0,0 +1,132 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : WorkStealingDeque.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#include <assert.h>
+#include "Atomic.h"
+#include "WorkStealingDeque.h"
+
+namespace TTP
+{
+
+WorkStealingDeque::Array::Array(long size)
+{
+    assert(size > 0 && (size & (size - 1)) == 0);
+    m_mask = size - 1;
+    m_tasks = new Task*[size];
+}
+
+WorkStealingDeque::Array::~Array()
+{
+    delete[] m_tasks;
+}
+
+Task* WorkStealingDeque::Array::get(long index) const
+{
+    return atomicLoad(&m_tasks[index & m_mask], __ATOMIC_RELAXED);
+}
+
+void WorkStealingDeque::Array::put(long index, Task *task)
+{
+    atomicStore(&m_tasks[index & m_mask], task, __ATOMIC_RELAXED);
+}
+
+WorkStealingDeque::WorkStealingDeque(long capacity)
+{
+    long size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    m_top = 0;
+    m_bottom = 0;
+    m_array = new Array(size);
+}
+
+WorkStealingDeque::~WorkStealingDeque()
+{
+    delete m_array;
+    for (size_t i = 0; i < m_retired.size(); ++i) {
+        delete m_retired[i];
+    }
+}
+
+WorkStealingDeque::Array* WorkStealingDeque::grow(Array *array, long top, long bottom)
+{
+    Array *bigger = new Array((array->m_mask + 1) << 1);
+    for (long i = top; i < bottom; ++i) {
+        bigger->put(i, array->get(i));
+    }
+    m_retired.push_back(array);
+    atomicStore(&m_array, bigger, __ATOMIC_RELEASE);
+    return bigger;
+}
+
+void WorkStealingDeque::push(Task *task)
+{
+    long b = atomicLoad(&m_bottom, __ATOMIC_RELAXED);
+    long t = atomicLoad(&m_top, __ATOMIC_ACQUIRE);
+    Array *a = atomicLoad(&m_array, __ATOMIC_RELAXED);
+    if (b - t > a->m_mask) {
+        a = grow(a, t, b);
+    }
+    a->put(b, task);
+    // publishes the slot to thieves, pairs with the acquire in steal()
+    atomicStore(&m_bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+Task* WorkStealingDeque::take()
+{
+    long b = atomicLoad(&m_bottom, __ATOMIC_RELAXED) - 1;
+    Array *a = atomicLoad(&m_array, __ATOMIC_RELAXED);
+    atomicStore(&m_bottom, b, __ATOMIC_RELAXED);
+    atomicFence();
+    long t = atomicLoad(&m_top, __ATOMIC_RELAXED);
+    Task *task = NULL;
+    if (t <= b) {
+        task = a->get(b);
+        if (t == b) {
+            // last element, race against the thieves for it
+            if (!atomicCas(&m_top, t, t + 1)) {
+                task = NULL;
+            }
+            atomicStore(&m_bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    }
+    else {
+        atomicStore(&m_bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+Task* WorkStealingDeque::steal()
+{
+    long t = atomicLoad(&m_top, __ATOMIC_ACQUIRE);
+    atomicFence();
+    long b = atomicLoad(&m_bottom, __ATOMIC_ACQUIRE);
+    Task *task = NULL;
+    if (t < b) {
+        Array *a = atomicLoad(&m_array, __ATOMIC_ACQUIRE);
+        task = a->get(t);
+        if (!atomicCas(&m_top, t, t + 1)) {
+            task = NULL;
+        }
+    }
+    return task;
+}
+
+long WorkStealingDeque::size() const
+{
+    long b = atomicLoad(&m_bottom, __ATOMIC_ACQUIRE);
+    long t = atomicLoad(&m_top, __ATOMIC_ACQUIRE);
+    return b > t ? b - t : 0;
+}
+
+bool WorkStealingDeque::empty() const
+{
+    return size() == 0;
+}
+
+} // namespace TTP
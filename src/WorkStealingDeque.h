@@ -0,0 +1,56 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : WorkStealingDeque.h
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+#ifndef WORKSTEALINGDEQUE_H_
+#define WORKSTEALINGDEQUE_H_
+#include <vector>
+#include "Task.h"
+
+namespace TTP
+{
+
+// Chase-Lev work-stealing deque (Le, Pop, Cohen, Zappa Nardelli, PPoPP'13).
+// Only the owning PoolThread may call push() and take(), which work on
+// the bottom end in LIFO order. Any other thread may call steal(), which
+// takes from the top end in FIFO order.
+class WorkStealingDeque
+{
+public:
+    explicit WorkStealingDeque(long capacity = 256);
+    ~WorkStealingDeque();
+    void push(Task *task);
+    // returns NULL if the deque is empty
+    Task* take();
+    // returns NULL if the deque is empty or another thief won the race
+    Task* steal();
+    bool empty() const;
+    long size() const;
+private:
+    // ring of task pointers, the size is a power of two
+    struct Array
+    {
+        long m_mask;
+        Task **m_tasks;
+        explicit Array(long size);
+        ~Array();
+        Task* get(long index) const;
+        void put(long index, Task *task);
+    };
+    Array* grow(Array *array, long top, long bottom);
+private:
+    WorkStealingDeque(const WorkStealingDeque&);
+    WorkStealingDeque& operator = (const WorkStealingDeque&);
+private:
+    volatile long m_top;
+    volatile long m_bottom;
+    Array * volatile m_array;
+    // arrays replaced by grow(), thieves may still read from them
+    std::vector<Array*> m_retired;
+};
+
+} // namespace TTP
+#endif /* WORKSTEALINGDEQUE_H_ */
@@ -0,0 +1,117 @@
+/*
+ *  Project   : TinyThreadPool
+ *  File      : cotest.cc
+ *  Author    : Your Name
+ *  Copyright : GPLv2
+ */
+
+// Built as C++20, the coroutine layer is not part of the C++98 library
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include "Coroutine.h"
+
+using namespace TTP;
+
+
+class NopTask : public Task
+{
+public:
+    void run() {}
+};
+
+CoTask<int> doubled(ThreadPool &pool, int i)
+{
+    co_await schedule(pool);
+    if (i < 0) {
+        throw std::runtime_error("negative input");
+    }
+    co_return i * 2;
+}
+
+CoTask<long> delayed(ThreadPool &pool)
+{
+    Timer timer;
+    timer.start();
+    co_await schedule(pool, 20, TimeUnit::MILLISECONDS);
+    co_return timer.elapsedMilliSeconds();
+}
+
+CoTask<void> failing(ThreadPool &pool)
+{
+    try {
+        co_await doubled(pool, -1);
+    }
+    catch (std::exception &e) {
+        std::cout << "Coroutine caught: " << e.what() << std::endl;
+    }
+}
+
+CoTask<long> summed(ThreadPool &pool, int count)
+{
+    long sum = 0;
+    for (int i = 0; i < count; ++i) {
+        sum += co_await doubled(pool, i);
+    }
+    co_return sum;
+}
+
+void testImmediateResume()
+{
+    /*Declare a Thread Pool with Min 2 and Max 2 Threads*/
+    ThreadPool pool(2,2);
+    pool.start();
+    /*Each step continues on a PoolThread right away*/
+    std::cout << "Coroutine sum: " << summed(pool, 100).get() << std::endl;
+}
+
+void testScheduledResume()
+{
+    ThreadPool pool(2,2);
+    pool.start();
+    /*The coroutine continues once the delay passed*/
+    long elapsed = delayed(pool).get();
+    std::cout << "Coroutine delayed " << (elapsed >= 20 ? "ok" : "too short") << std::endl;
+}
+
+void testExceptionResume()
+{
+    ThreadPool pool(2,2);
+    pool.start();
+    /*The exception of the awaited coroutine reaches the awaiter*/
+    failing(pool).get();
+}
+
+void testRefusedResume()
+{
+    /*Declare a bounded Thread Pool that is not started yet*/
+    PoolOptions options;
+    options.m_initThreads = 1;
+    options.m_maxThreads = 1;
+    options.m_queueEngine = PoolOptions::QUEUE_RING;
+    options.m_queueCapacity = 4;
+    ThreadPool pool(options);
+    std::vector<NopTask> tasks(64);
+    size_t queued = 0;
+    while (queued < tasks.size() && pool.execute(tasks[queued])) {
+        ++queued;
+    }
+    /*A full queue resumes the coroutine on the calling thread*/
+    std::cout << "Coroutine refused: " << summed(pool, 3).get() << std::endl;
+    pool.start();
+    pool.joinAll();
+}
+
+int main()
+{
+    /*Test the Immediate Resume mechanism*/
+    testImmediateResume();
+    /*Test the Scheduled Resume mechanism*/
+    testScheduledResume();
+    /*Test the Exception Propagation mechanism*/
+    testExceptionResume();
+    /*Test the Refused Resume mechanism*/
+    testRefusedResume();
+    return 0;
+}
@@ -7,7 +7,10 @@
 
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
+#include <vector>
 #include "ThreadPool.h"
+#include "ParallelFor.h"
 
 using namespace TTP;
 
@@ -54,6 +57,128 @@ private:
     int m_num;
 };
 
+class MyCallable : public Callable<int>
+{
+public:
+    MyCallable(int j){m_num = j;}
+    ~MyCallable(){}
+    int call() {
+        if (m_num < 0) {
+            throw std::runtime_error("negative input");
+        }
+        return m_num * m_num;
+    }
+private:
+    int m_num;
+};
+
+class MyFunctor
+{
+public:
+    explicit MyFunctor(int j):m_num(j) {}
+    void operator()() const {
+        std::cout << "Functor (" << m_num << ") run ok !" << std::endl;
+    }
+private:
+    int m_num;
+};
+
+class MyLargeFunctor
+{
+public:
+    explicit MyLargeFunctor(int j):m_num(j) {}
+    void operator()() const {
+        std::cout << "Large functor (" << m_num << ") run ok !" << std::endl;
+    }
+private:
+    int m_num;
+    // too large for a FunctionTask, copied into a block of the pool
+    char m_payload[200];
+};
+
+class MyTicker : public Task
+{
+public:
+    MyTicker():m_runs(0) {}
+    void run() {
+        __sync_fetch_and_add(&m_runs, 1);
+    }
+    int runs() {
+        return __sync_fetch_and_add(&m_runs, 0);
+    }
+private:
+    volatile int m_runs;
+};
+
+class MyNap : public Task
+{
+public:
+    explicit MyNap(long milliseconds):m_milliseconds(milliseconds) {}
+    void run() {
+        Thread::mSleep(m_milliseconds);
+    }
+private:
+    long m_milliseconds;
+};
+
+class MySquare
+{
+public:
+    long operator()(long i) const { return i * i; }
+};
+
+class MySum
+{
+public:
+    long operator()(long a, long b) const { return a + b; }
+};
+
+class MyMark
+{
+public:
+    MyMark(volatile long *hits, long failAt):m_hits(hits), m_failAt(failAt) {}
+    void operator()(long i) const {
+        if (i == m_failAt) {
+            throw std::runtime_error("index out of order");
+        }
+        atomicAdd(&m_hits[i], 1L);
+    }
+private:
+    volatile long *m_hits;
+    long m_failAt;
+};
+
+class MyGauge : public Task
+{
+public:
+    MyGauge(volatile long *busy, volatile long *peak, volatile long *runs)
+        :m_busy(busy), m_peak(peak), m_runs(runs) {}
+    void run() {
+        long busy = atomicAdd(m_busy, 1L);
+        long peak = atomicLoad(m_peak);
+        while (busy > peak && !atomicCas(m_peak, peak, busy)) {
+        }
+        // keeps the backlog up long enough for the pool to add threads
+        Thread::mSleep(20);
+        atomicSub(m_busy, 1L);
+        atomicAdd(m_runs, 1L);
+    }
+private:
+    volatile long *m_busy;
+    volatile long *m_peak;
+    volatile long *m_runs;
+};
+
+bool checkMarks(volatile long *hits, long count)
+{
+    bool once = true;
+    for (long i = 0; i < count; ++i) {
+        once = once && hits[i] == 1;
+        hits[i] = 0;
+    }
+    return once;
+}
+
 void testDirectExecution()
 {
     /*Declare a Thread Pool with Min 2 and Max 5 Threads*/
@@ -86,6 +211,7 @@ void testPrioritizedExecution()
     MyTask task8(8);
     MyTask task9(9);
     MyTask task10(10);
+    MyTask task40(40);
     /* Start Thread Pool*/
     pool.start();
     /*Execute The Tasks on priority*/
@@ -94,6 +220,8 @@ void testPrioritizedExecution()
     pool.execute(task8,4);
     pool.execute(task9,1);
     pool.execute(task10,4);
+    /*Out of range priorities are clamped to Low 1*/
+    pool.execute(task40,0);
     /*Wait for completion of all Tasks*/
     pool.joinAll();
 }
@@ -141,7 +269,455 @@ void testDirectScheduledExecution()
     /*Wait for completion of all Tasks*/
     pool.joinAll();
 }
+void testCancelledExecution()
+{
+    /*Declare a Thread Pool with Min 2 and Max 5 Threads*/
+    ThreadPool pool(2,5);
+    MyTask task36(36);
+    MyTask task37(37);
+    /* Start Thread Pool*/
+    pool.start();
+    /*Keep the handles of the scheduled Tasks*/
+    ScheduleHandle timeout = pool.schedule(task36,1,TimeUnit::HOURS);
+    ScheduleHandle retry = pool.schedule(task37,1,TimeUnit::HOURS);
+    /*Withdraw one Task, bring the other one forward*/
+    if (timeout.cancel()) {
+        std::cout << "Scheduled Task (36) cancelled !" << std::endl;
+    }
+    retry.reschedule(10,TimeUnit::MILLISECONDS);
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+}
 
+void testPeriodicExecution()
+{
+    /*Declare a Thread Pool with Min 2 and Max 5 Threads*/
+    ThreadPool pool(2,5);
+    MyTicker ticker38;
+    /* Start Thread Pool*/
+    pool.start();
+    /*Run the Task every 10 milliseconds on a fixed rate*/
+    ScheduleHandle ticks = pool.scheduleAtFixedRate(ticker38,10,10,TimeUnit::MILLISECONDS);
+    while (ticker38.runs() < 3) {
+        Thread::mSleep(5);
+    }
+    /*A periodic Task runs until it is cancelled*/
+    if (ticks.cancel()) {
+        std::cout << "Periodic Task (38) cancelled !" << std::endl;
+    }
+    pool.joinAll();
+}
+
+void testPreciseExecution()
+{
+    /*Declare a Thread Pool with a spinning precision timer*/
+    PoolOptions options;
+    options.m_initThreads = 2;
+    options.m_maxThreads = 5;
+    options.m_timerSpin = 20000;
+    ThreadPool pool(options);
+    MyTask task39(39);
+    /* Start Thread Pool*/
+    pool.start();
+    /*Run the Task 500 microseconds from now*/
+    pool.schedule(task39,500,TimeUnit::MICROSECONDS);
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+}
+
+void testWeightedExecution()
+{
+    /*Declare a Priority Pool where Low 1 gets one of every three Tasks*/
+    PoolOptions options;
+    options.m_initThreads = 2;
+    options.m_maxThreads = 5;
+    options.m_prioritypooling = true;
+    options.m_lowp = 1;
+    options.m_highp = 2;
+    options.m_weights.push_back(1);
+    options.m_weights.push_back(2);
+    ThreadPool pool(options);
+    MyTask task41(41);
+    MyTask task42(42);
+    /* Start Thread Pool*/
+    pool.start();
+    pool.execute(task41,1);
+    pool.execute(task42,2);
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+    PriorityStats stats;
+    if (pool.priorityStats(1,stats)) {
+        std::cout << "Low Priority dispatched " << stats.m_dispatched << " Task(s) !" << std::endl;
+    }
+}
+
+void testReservedExecution()
+{
+    /*Declare a Priority Pool keeping one of 3 Threads for Priority 3 and above*/
+    PoolOptions options;
+    options.m_initThreads = 3;
+    options.m_maxThreads = 5;
+    options.m_prioritypooling = true;
+    options.m_lowp = 1;
+    options.m_highp = 4;
+    options.m_reservedThreads = 1;
+    options.m_reservedPriority = 3;
+    ThreadPool pool(options);
+    MyTask task43(43);
+    MyTask task44(44);
+    MyTask task45(45);
+    /*Short Tasks may borrow the reserved Thread*/
+    task45.m_short = true;
+    /* Start Thread Pool*/
+    pool.start();
+    pool.execute(task43,1);
+    pool.execute(task44,4);
+    pool.execute(task45,1);
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+}
+
+void testDeadlineExecution()
+{
+    /*Declare a Pool running the Task with the nearest Deadline first*/
+    PoolOptions options;
+    options.m_initThreads = 2;
+    options.m_maxThreads = 5;
+    options.m_prioritypooling = true;
+    options.m_priorityEngine = PoolOptions::PRIORITY_DEADLINE;
+    ThreadPool pool(options);
+    MyTask task46(46);
+    MyTask task47(47);
+    /* Start Thread Pool*/
+    pool.start();
+    /*Execute The Tasks within their Deadlines*/
+    pool.executeWithin(task46,1,TimeUnit::SECONDS);
+    pool.executeWithin(task47,3,TimeUnit::MILLISECONDS);
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+    std::cout << "Deadlines missed: " << pool.deadlineMisses() << std::endl;
+}
+
+void testRelaxedExecution()
+{
+    /*Declare a Priority Pool on the relaxed MultiQueue engine*/
+    PoolOptions options;
+    options.m_initThreads = 2;
+    options.m_maxThreads = 5;
+    options.m_prioritypooling = true;
+    options.m_lowp = 1;
+    options.m_highp = 4;
+    options.m_priorityEngine = PoolOptions::PRIORITY_MULTIQUEUE;
+    ThreadPool pool(options);
+    MyTask task48(48);
+    MyTask task49(49);
+    /* Start Thread Pool*/
+    pool.start();
+    /*Execute The Tasks on approximate priority*/
+    pool.execute(task48,1);
+    pool.execute(task49,4);
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+}
+
+void testEngineFifoExecution()
+{
+    /*Declare a FIFO Thread Pool, the priority engine is left unused*/
+    PoolOptions options;
+    options.m_initThreads = 2;
+    options.m_maxThreads = 5;
+    options.m_spinMicros = 200;
+    options.m_priorityEngine = PoolOptions::PRIORITY_MULTIQUEUE;
+    ThreadPool pool(options);
+    MyTask task54(54);
+    MyTask task55(55);
+    /* Start Thread Pool*/
+    pool.start();
+    /*Execute The Tasks in submission order*/
+    pool.execute(task54);
+    pool.execute(task55);
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+}
+
+void testElasticExecution()
+{
+    /*Declare a Thread Pool of one Thread that grows under a backlog*/
+    PoolOptions options;
+    options.m_initThreads = 1;
+    options.m_maxThreads = 4;
+    options.m_keepAlive = 100;
+    options.m_growBacklog = 2;
+    ThreadPool pool(options);
+    volatile long busy = 0;
+    volatile long peak = 0;
+    volatile long runs = 0;
+    std::vector<MyGauge> tasks(16, MyGauge(&busy, &peak, &runs));
+    /* Start Thread Pool*/
+    pool.start();
+    for (int round = 0; round < 2; ++round) {
+        /*Queue a burst, more Threads are added to serve it*/
+        atomicStore(&peak, 0L);
+        for (int i = 0; i < 16; ++i) {
+            pool.execute(tasks[i]);
+        }
+        while (atomicLoad(&runs) < 16 * (round + 1)) {
+            Thread::mSleep(10);
+        }
+        std::cout << "Elastic burst (" << round << ") "
+                  << (atomicLoad(&peak) > 1 ? "grew" : "did not grow") << " !" << std::endl;
+        /*Let the added Threads retire before the next burst restarts them*/
+        Thread::mSleep(300);
+    }
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+}
+
+void testIdleExecution()
+{
+    /*Declare a Thread Pool with Min 2 and Max 5 Threads*/
+    ThreadPool pool(2,5);
+    MyNap nap(200);
+    /* Start Thread Pool*/
+    pool.start();
+    pool.execute(nap);
+    /*The wait times out while the Task sleeps, then sees the Pool idle*/
+    bool early = pool.waitIdle(20);
+    bool late = pool.waitIdle(5000);
+    std::cout << "Pool idle " << (early ? "too early" : "not before the Task")
+              << (late ? " and after it" : " nor after it") << " !" << std::endl;
+    pool.joinAll();
+}
+
+void testParkedExecution()
+{
+    /*Declare a Thread Pool with Min 4 and Max 4 Threads*/
+    ThreadPool pool(4,4);
+    volatile long busy = 0;
+    volatile long peak = 0;
+    volatile long runs = 0;
+    std::vector<MyGauge> tasks(12, MyGauge(&busy, &peak, &runs));
+    std::vector<Task*> batch;
+    for (int i = 4; i < 12; ++i) {
+        batch.push_back(&tasks[i]);
+    }
+    /* Start Thread Pool*/
+    pool.start();
+    for (int round = 0; round < 5; ++round) {
+        /*Let every Thread park, then wake them with single Tasks*/
+        Thread::mSleep(50);
+        for (int i = 0; i < 4; ++i) {
+            pool.execute(tasks[i]);
+        }
+        pool.waitIdle(5000);
+        /*Park them again and wake them with one batch*/
+        Thread::mSleep(50);
+        pool.executeBatch(batch);
+        pool.waitIdle(5000);
+    }
+    std::cout << "Parked pool ran " << atomicLoad(&runs) << " of 60 Tasks !" << std::endl;
+    pool.joinAll();
+}
+
+void testSpinningExecution()
+{
+    /*Declare a Thread Pool whose idle Threads spin before they park*/
+    PoolOptions options;
+    options.m_initThreads = 2;
+    options.m_maxThreads = 5;
+    options.m_spinMicros = 200;
+    ThreadPool pool(options);
+    MyTask task50(50);
+    MyTask task51(51);
+    /* Start Thread Pool*/
+    pool.start();
+    /*Execute The Tasks, an idle Thread picks each one up*/
+    pool.execute(task50);
+    pool.execute(task51);
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+}
+
+void testNumaExecution()
+{
+    /*Declare a Thread Pool spread over the NUMA nodes of the machine*/
+    PoolOptions options;
+    options.m_initThreads = 2;
+    options.m_maxThreads = 5;
+    options.m_numaAware = true;
+    ThreadPool pool(options);
+    MyTask task52(52);
+    MyTask task53(53);
+    /* Start Thread Pool*/
+    pool.start();
+    /*Execute The Tasks on the first and on the last node*/
+    pool.executeOn(task52, 0);
+    pool.executeOn(task53, pool.numaNodes() - 1);
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+}
+
+void testBatchExecution()
+{
+    /*Declare a Thread Pool with Min 2 and Max 5 Threads*/
+    ThreadPool pool(2,5);
+    /*Create the Tasks*/
+    MyTask task21(21);
+    MyTask task22(22);
+    MyTask task23(23);
+    MyTask task24(24);
+    Task *tasks[] = {&task21, &task22, &task23, &task24};
+    /* Start Thread Pool*/
+    pool.start();
+    /*Queue all Tasks under one lock*/
+    pool.executeBatch(tasks, 4);
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+}
+
+void testRingExecution()
+{
+    /*Declare a Thread Pool on a lock-free ring of 4 Tasks*/
+    PoolOptions options;
+    options.m_initThreads = 1;
+    options.m_maxThreads = 1;
+    options.m_queueEngine = PoolOptions::QUEUE_RING;
+    options.m_queueCapacity = 4;
+    ThreadPool pool(options);
+    MyTask task59(59);
+    MyTask task60(60);
+    MyTask task61(61);
+    MyTask task62(62);
+    MyTask task63(63);
+    MyTask task64(64);
+    Task *first[] = {&task59, &task60, &task61};
+    Task *second[] = {&task62, &task63, &task64};
+    /*Fill the ring before the Thread Pool drains it*/
+    size_t queued = pool.executeBatch(first, 3);
+    queued += pool.executeBatch(second, 3);
+    bool refused = !pool.execute(task63);
+    std::cout << "Ring queue took " << queued << " of 6 Tasks"
+              << (refused ? ", then refused" : ", then took more") << " !" << std::endl;
+    /* Start Thread Pool*/
+    pool.start();
+    /*Wait for completion of the queued Tasks*/
+    pool.joinAll();
+}
+
+void testFutureExecution()
+{
+    /*Declare a Thread Pool with Min 2 and Max 5 Threads*/
+    ThreadPool pool(2,5);
+    MyCallable call25(25);
+    MyCallable call26(-26);
+    /* Start Thread Pool*/
+    pool.start();
+    /*Submit the Callables, each Future carries one result*/
+    Future<int> f25 = pool.submit(call25);
+    Future<int> f26 = pool.submit(call26);
+    /*Wait for the results only*/
+    std::cout << "Callable (25) returned " << f25.get() << " !" << std::endl;
+    try {
+        f26.get();
+    }
+    catch(TaskException &e) {
+        std::cout << "Callable (26) failed : " << e.what() << " !" << std::endl;
+    }
+    /*A Future that was never submitted has no result to wait for*/
+    Future<int> unset;
+    try {
+        unset.get();
+    }
+    catch(std::logic_error &e) {
+        std::cout << "Unset Future refused : " << e.what() << " !" << std::endl;
+    }
+}
+
+void testGroupExecution()
+{
+    /*Declare a Thread Pool with Min 2 and Max 5 Threads*/
+    ThreadPool pool(2,5);
+    MyTask task27(27);
+    MyTask task28(28);
+    MyTask task29(29);
+    MyTask task57(57);
+    MyTask task58(58);
+    /* Start Thread Pool*/
+    pool.start();
+    /*Track a subset of the pool's Tasks in a group*/
+    TaskGroup group(pool);
+    group.execute(task27);
+    group.execute(task28);
+    /*Task 58 follows the grouped Task 57*/
+    pool.then(&task57, &task58);
+    group.execute(task57);
+    pool.execute(task29);
+    /*Wait for the grouped Tasks only*/
+    group.wait();
+    std::cout << "Task group (27, 28, 57) completed !" << std::endl;
+    pool.joinAll();
+}
+
+void testFunctorExecution()
+{
+    /*Declare a Thread Pool with Min 2 and Max 5 Threads*/
+    ThreadPool pool(2,5);
+    /* Start Thread Pool*/
+    pool.start();
+    /*Execute copies of plain functors, no Task subclass needed*/
+    pool.execute(MyFunctor(34));
+    pool.execute(MyFunctor(35));
+    pool.execute(MyLargeFunctor(56));
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+}
+
+void testContinuationExecution()
+{
+    /*Declare a Thread Pool with Min 2 and Max 5 Threads*/
+    ThreadPool pool(2,5);
+    MyTask task30(30);
+    MyTask task31(31);
+    MyTask task32(32);
+    MyTask task33(33);
+    Task *both[] = {&task31, &task32};
+    /* Start Thread Pool*/
+    pool.start();
+    /*Task 31 and 32 follow Task 30, Task 33 follows both of them*/
+    pool.then(&task30, &task31);
+    pool.then(&task30, &task32);
+    pool.whenAll(both, 2, &task33);
+    /*Only the first Task of the graph is executed directly*/
+    pool.execute(task30);
+    /*Wait for completion of all Tasks*/
+    pool.joinAll();
+}
+
+void testParallelExecution()
+{
+    /*Declare a Thread Pool with Min 2 and Max 5 Threads*/
+    ThreadPool pool(2,5);
+    /* Start Thread Pool*/
+    pool.start();
+    /*Split the loop into chunks run by the pool and the caller*/
+    long sum = parallelReduce(pool, 1L, 101L, 0L, 0L, MySquare(), MySum(),
+                              Partition::GUIDED);
+    std::cout << "Parallel sum of squares (1..100) is " << sum << " !" << std::endl;
+    /*Every index is visited once, whatever the partition*/
+    volatile long hits[1000] = {0};
+    parallelFor(pool, 0L, 1000L, 0L, MyMark(hits, -1), Partition::STATIC);
+    std::cout << "Parallel static loop " << (checkMarks(hits, 1000) ? "ok" : "failed") << " !" << std::endl;
+    parallelFor(pool, 0L, 1000L, 7L, MyMark(hits, -1), Partition::DYNAMIC);
+    std::cout << "Parallel dynamic loop " << (checkMarks(hits, 1000) ? "ok" : "failed") << " !" << std::endl;
+    /*A throwing body fails the whole loop on the calling thread*/
+    try {
+        parallelFor(pool, 0L, 1000L, 0L, MyMark(hits, 500), Partition::DYNAMIC);
+        std::cout << "Parallel loop did not fail !" << std::endl;
+    }
+    catch(TaskException &e) {
+        std::cout << "Parallel loop failed : " << e.what() << " !" << std::endl;
+    }
+}
 
 int main()
 {
@@ -160,6 +736,46 @@ int main()
     pool.joinAll();
     /*Test the Direct Thread Pooling mechanism*/
     testDirectExecution();
+    /*Test the Batch Thread Pooling mechanism*/
+    testBatchExecution();
+    /*Test the Bounded Queue mechanism*/
+    testRingExecution();
+    /*Test the Future based Thread Pooling mechanism*/
+    testFutureExecution();
+    /*Test the Task Group Thread Pooling mechanism*/
+    testGroupExecution();
+    /*Test the Functor Thread Pooling mechanism*/
+    testFunctorExecution();
+    /*Test the Continuation Thread Pooling mechanism*/
+    testContinuationExecution();
+    /*Test the Parallel Loop mechanism*/
+    testParallelExecution();
+    /*Test the Cancellable Scheduling mechanism*/
+    testCancelledExecution();
+    /*Test the Periodic Scheduling mechanism*/
+    testPeriodicExecution();
+    /*Test the Precision Timer mechanism*/
+    testPreciseExecution();
+    /*Test the Weighted Priority mechanism*/
+    testWeightedExecution();
+    /*Test the Reserved Thread mechanism*/
+    testReservedExecution();
+    /*Test the Earliest Deadline First mechanism*/
+    testDeadlineExecution();
+    /*Test the Relaxed Priority mechanism*/
+    testRelaxedExecution();
+    /*Test the FIFO Pool with a Priority Engine mechanism*/
+    testEngineFifoExecution();
+    /*Test the Elastic Growth mechanism*/
+    testElasticExecution();
+    /*Test the Idle Wait mechanism*/
+    testIdleExecution();
+    /*Test the Parked Thread Wakeup mechanism*/
+    testParkedExecution();
+    /*Test the Spinning Idle Thread mechanism*/
+    testSpinningExecution();
+    /*Test the NUMA Placement mechanism*/
+    testNumaExecution();
     /*Test the Scheduled Thread Pooling mechanism*/
     testScheduledExecution();
     /*Test the Priority Driven Thread Pooling mechanism*/